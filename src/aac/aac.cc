@@ -2,9 +2,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <glib.h>
+#include <glib/gstdio.h>
 #include <neaacdec.h>
 
 #include <audacious/audtag.h>
+#include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
 #include <libaudcore/runtime.h>
@@ -46,12 +49,13 @@ const char * const AACDecoder::exts[] = {"aac", nullptr};
 /// \param num (out) number of audio frames in this ADTS frame
 /// \return size of the ADTS frame in bytes
 /// aac_parse_frames needs a buffer at least 8 bytes long
+static const int srates[] =
+ { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000,
+     11025, 8000, 0, 0, 0 };
+
 int aac_parse_frame (unsigned char * buf, int *srate, int *num)
 {
     int i = 0, sr, fl = 0;
-    static int srates[] =
-     { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000,
-         11025, 8000, 0, 0, 0 };
 
     if ((buf[i] != 0xFF) || ((buf[i + 1] & 0xF6) != 0xF0))
         return 0;
@@ -252,6 +256,294 @@ static void calc_aac_info (VFSFile & handle, int * length, int * bitrate,
         NeAACDecClose (decoder);
 }
 
+/*
+ * Raw ADTS streams have no seek table, so one is built by walking the frame
+ * headers (without decoding anything) the first time a local file is seeked in.
+ * Every INDEX_STRIDE-th frame is recorded together with the number of raw data
+ * blocks (1024 samples each) that precede it, which gives an exact length and
+ * lets seeks land on the right sample.  The index is cached in the user's
+ * config directory, keyed by file name and checked against the size and
+ * modification time of the file; at most INDEX_CACHE_MAX files are kept.
+ */
+
+#define INDEX_STRIDE 16
+#define INDEX_MAGIC "ADTSIDX2"
+#define INDEX_CACHE_MAX 1000
+#define SCAN_BUFSIZE 65536
+#define MAX_FRAME_SIZE 8191  /* 13-bit length field */
+
+struct IndexEntry {
+    int64_t offset;  /* file position of the frame header */
+    int64_t block;   /* raw data blocks before this frame */
+};
+
+struct FrameIndex {
+    int samplerate = 0;  /* from the ADTS headers */
+    int64_t blocks = 0;
+    int64_t bytes = 0;
+    Index<IndexEntry> entries;
+
+    int64_t length () const
+        { return aud::rescale<int64_t> (blocks * 1024, samplerate, 1000); }
+};
+
+/* Checks for a complete ADTS header (7 bytes) at <buf>.  Returns the frame
+ * length or 0 if there is no valid header. */
+static int parse_adts_header (const unsigned char * buf, int * srate, int * blocks)
+{
+    if (buf[0] != 0xff || (buf[1] & 0xf6) != 0xf0)
+        return 0;
+
+    int sr = (buf[2] >> 2) & 0x0f;
+    int len = ((buf[3] & 0x03) << 11) | (buf[4] << 3) | (buf[5] >> 5);
+
+    if (sr > 11 || len < 7)
+        return 0;
+
+    * srate = srates[sr];
+    * blocks = (buf[6] & 0x03) + 1;
+    return len;
+}
+
+static int64_t skip_id3v2 (VFSFile & file)
+{
+    unsigned char buf[10];
+
+    if (file.fseek (0, VFS_SEEK_SET) || file.fread (buf, 1, 10) != 10 ||
+     strncmp ((char *) buf, "ID3", 3))
+        return 0;
+
+    return 10 + (buf[6] << 21) + (buf[7] << 14) + (buf[8] << 7) + buf[9];
+}
+
+static bool build_index (VFSFile & file, FrameIndex & index)
+{
+    int64_t start = skip_id3v2 (file);
+    if (file.fseek (start, VFS_SEEK_SET))
+        return false;
+
+    Index<unsigned char> buf;
+    buf.resize (SCAN_BUFSIZE);
+
+    int64_t buf_pos = start;  /* file position of buf[0] */
+    int64_t frames = 0;
+    int filled = 0, used = 0;
+    bool eof = false;
+
+    while (1)
+    {
+        /* keep at least one whole frame buffered */
+        if (! eof && filled - used < MAX_FRAME_SIZE)
+        {
+            filled -= used;
+            memmove (buf.begin (), buf.begin () + used, filled);
+            buf_pos += used;
+            used = 0;
+
+            int64_t got = file.fread (buf.begin () + filled, 1, SCAN_BUFSIZE - filled);
+            eof = (got < SCAN_BUFSIZE - filled);
+            filled += aud::max (got, (int64_t) 0);
+        }
+
+        if (filled - used < 7)
+            break;
+
+        int srate, blocks;
+        int len = parse_adts_header (buf.begin () + used, & srate, & blocks);
+
+        if (! len || (index.samplerate && srate != index.samplerate))
+        {
+            /* resynchronize after garbage */
+            used ++;
+            continue;
+        }
+
+        if (len > filled - used)
+            break;  /* truncated last frame */
+
+        if (! (frames % INDEX_STRIDE))
+            index.entries.append (IndexEntry {buf_pos + used, index.blocks});
+
+        index.samplerate = srate;
+        index.blocks += blocks;
+        index.bytes += len;
+        frames ++;
+        used += len;
+    }
+
+    return frames > 0;
+}
+
+static StringBuf index_dir ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "aac-index"});
+}
+
+static StringBuf index_filename (const char * filename)
+{
+    return filename_build ({index_dir (), str_printf ("%08x", String (filename).hash ())});
+}
+
+/* Returns the modification time of a local file, or -1. */
+static int64_t get_mtime (const char * filename)
+{
+    StringBuf path = uri_to_filename (filename);
+    GStatBuf st;
+
+    if (! path || g_stat (path, & st) < 0)
+        return -1;
+
+    return st.st_mtime;
+}
+
+/* Cache file layout (native byte order):
+ * magic[8], file size, modification time, samplerate, blocks, bytes,
+ * number of entries, length of file name, file name, entries */
+
+static bool load_index (const char * filename, int64_t size, int64_t mtime,
+ FrameIndex & index)
+{
+    char * data;
+    gsize len;
+
+    if (! g_file_get_contents (index_filename (filename), & data, & len, nullptr))
+        return false;
+
+    const char * p = data, * end = data + len;
+    int64_t fields[7];
+    bool valid = false;
+
+    if (len >= 8 + sizeof fields && ! memcmp (p, INDEX_MAGIC, 8))
+    {
+        memcpy (fields, p + 8, sizeof fields);
+        p += 8 + sizeof fields;
+
+        int64_t n_entries = fields[5], name_len = fields[6];
+
+        valid = (fields[0] == size && fields[1] == mtime && fields[2] > 0 &&
+         n_entries > 0 && name_len == (int64_t) strlen (filename) &&
+         end - p == name_len + n_entries * (int64_t) sizeof (IndexEntry) &&
+         ! memcmp (p, filename, name_len));
+
+        if (valid)
+        {
+            p += name_len;
+
+            index.samplerate = fields[2];
+            index.blocks = fields[3];
+            index.bytes = fields[4];
+            index.entries.insert (0, n_entries);
+            memcpy (index.entries.begin (), p, sizeof (IndexEntry) * n_entries);
+        }
+    }
+
+    g_free (data);
+    return valid;
+}
+
+struct CacheFile {
+    String path;
+    int64_t mtime;
+};
+
+/* Removes the least recently written files once the cache has grown past
+ * INDEX_CACHE_MAX files. */
+static void prune_index_dir (const char * dir)
+{
+    GDir * folder = g_dir_open (dir, 0, nullptr);
+    if (! folder)
+        return;
+
+    Index<CacheFile> files;
+    const char * name;
+
+    while ((name = g_dir_read_name (folder)))
+    {
+        StringBuf path = filename_build ({dir, name});
+        GStatBuf st;
+
+        if (g_stat (path, & st) == 0)
+            files.append (String (path), (int64_t) st.st_mtime);
+    }
+
+    g_dir_close (folder);
+
+    if (files.len () <= INDEX_CACHE_MAX)
+        return;
+
+    files.sort ([] (const CacheFile & a, const CacheFile & b)
+        { return (a.mtime > b.mtime) - (a.mtime < b.mtime); });
+
+    /* remove a tenth more than needed so that this is not done every time */
+    int excess = files.len () - INDEX_CACHE_MAX * 9 / 10;
+
+    for (int i = 0; i < excess; i ++)
+        g_unlink (files[i].path);
+}
+
+static void save_index (const char * filename, int64_t size, int64_t mtime,
+ const FrameIndex & index)
+{
+    StringBuf dir = index_dir ();
+
+    if (g_mkdir_with_parents (dir, 0755) != 0)
+    {
+        AUDERR ("Failed to create %s\n", (const char *) dir);
+        return;
+    }
+
+    prune_index_dir (dir);
+
+    int64_t name_len = strlen (filename);
+    int64_t fields[7] = {size, mtime, index.samplerate, index.blocks,
+     index.bytes, index.entries.len (), name_len};
+
+    Index<char> data;
+    data.insert (INDEX_MAGIC, 0, 8);
+    data.insert ((const char *) fields, -1, sizeof fields);
+    data.insert (filename, -1, name_len);
+    data.insert ((const char *) index.entries.begin (), -1,
+     sizeof (IndexEntry) * index.entries.len ());
+
+    StringBuf path = index_filename (filename);
+    if (! g_file_set_contents (path, data.begin (), data.len (), nullptr))
+        AUDERR ("Failed to write %s\n", (const char *) path);
+}
+
+/* Loads the cached index or, if <build> is set, builds it.  Only local files
+ * are indexed, since indexing means reading the whole file. */
+static bool get_index (const char * filename, VFSFile & file, bool build,
+ FrameIndex & index)
+{
+    if (strncmp (filename, "file://", 7))
+        return false;
+
+    int64_t size = file.fsize ();
+    int64_t mtime = get_mtime (filename);
+    if (size < 0 || mtime < 0)
+        return false;
+
+    if (load_index (filename, size, mtime, index))
+        return true;
+
+    if (! build)
+        return false;
+
+    int64_t time = g_get_monotonic_time ();
+
+    if (! build_index (file, index))
+    {
+        index = FrameIndex ();
+        return false;
+    }
+
+    AUDDBG ("Built frame index for %s in %d ms.\n", filename,
+     (int) ((g_get_monotonic_time () - time) / 1000));
+
+    save_index (filename, size, mtime, index);
+    return true;
+}
+
 bool AACDecoder::read_tag (const char * filename, VFSFile & file, Tuple & tuple,
  Index<char> * image)
 {
@@ -259,8 +551,20 @@ bool AACDecoder::read_tag (const char * filename, VFSFile & file, Tuple & tuple,
 
     tuple.set_str (Tuple::Codec, "MPEG-2/4 AAC");
 
-    // TODO: error handling
-    calc_aac_info (file, &length, &bitrate, &samplerate, &channels);
+    /* the index is not built here, since that would mean reading every
+     * file in full when it is added to the playlist */
+    FrameIndex index;
+
+    if (get_index (filename, file, false, index) && index.length () > 0)
+    {
+        length = index.length ();
+        bitrate = index.bytes * 8 / length;  /* bits per millisecond */
+    }
+    else
+    {
+        // TODO: error handling
+        calc_aac_info (file, &length, &bitrate, &samplerate, &channels);
+    }
 
     if (length > 0)
         tuple.set_int (Tuple::Length, length);
@@ -322,6 +626,81 @@ static void aac_seek (VFSFile & file, NeAACDecHandle dec, int time, int len,
     }
 }
 
+/* Seeks to <time> using the frame index.  Decoding resumes at the frame
+ * containing the target.  Returns the number of decoded samples (per channel)
+ * to drop.
+ *
+ * faad outputs each frame overlapped with the one before it, so the output of
+ * the frame at block n covers blocks n - 1 to n.  After a seek, the overlap
+ * buffer still holds audio from before the seek, so the output of the first
+ * frame is not valid and is dropped as well.  At block 0, faad drops that
+ * output itself (the frame counter is reset by NeAACDecPostSeekReset). */
+static int64_t index_seek (VFSFile & file, NeAACDecHandle dec,
+ const FrameIndex & index, int time, int out_rate, unsigned char * buf,
+ int size, int * buflen)
+{
+    int64_t target = aud::rescale<int64_t> (time, 1000, index.samplerate) / 1024;
+    int64_t start = aud::clamp (target, (int64_t) 0, index.blocks);
+
+    /* last entry at or before the start block */
+    int lo = 0, hi = index.entries.len () - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (index.entries[mid].block <= start)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    const IndexEntry & entry = index.entries[lo];
+    int64_t block = entry.block;
+
+    if (file.fseek (entry.offset, VFS_SEEK_SET))
+    {
+        * buflen = 0;
+        return 0;
+    }
+
+    * buflen = file.fread (buf, 1, size);
+
+    /* skip whole frames using only their headers */
+    while (* buflen >= 7)
+    {
+        int srate, blocks;
+        int len = parse_adts_header (buf, & srate, & blocks);
+
+        if (! len || len > * buflen || block + blocks > start)
+            break;
+
+        * buflen -= len;
+        memmove (buf, buf + len, * buflen);
+        * buflen += file.fread (buf + * buflen, 1, size - * buflen);
+        block += blocks;
+    }
+
+    /* == START DECODING == */
+
+    unsigned char chan;
+    unsigned long rate;
+    int used;
+
+    if ((used = NeAACDecInit (dec, buf, * buflen, & rate, & chan)))
+    {
+        * buflen -= used;
+        memmove (buf, buf + used, * buflen);
+        * buflen += file.fread (buf + * buflen, 1, size - * buflen);
+    }
+
+    NeAACDecPostSeekReset (dec, block);
+
+    /* first block whose audio is output */
+    int64_t first = aud::max (block - 1, (int64_t) 0);
+
+    return aud::rescale<int64_t> (time, 1000, out_rate) -
+     aud::rescale<int64_t> (first * 1024, index.samplerate, out_rate);
+}
+
 bool AACDecoder::play (const char * filename, VFSFile & file)
 {
     NeAACDecHandle decoder = 0;
@@ -342,6 +721,31 @@ bool AACDecoder::play (const char * filename, VFSFile & file)
     decoder_config->outputFormat = FAAD_FMT_FLOAT;
     NeAACDecSetConfiguration (decoder, decoder_config);
 
+    /* == LOAD FRAME INDEX == */
+
+    /* building the index means reading the whole file, so playback starts
+     * without one unless it is cached; it is built on the first seek */
+    FrameIndex index;
+    int64_t discard = 0;
+
+    /* the length from read_tag() may only have been estimated */
+    auto apply_index = [&] ()
+    {
+        int length = index.length ();
+
+        if (length > 0 && length != tuple.get_int (Tuple::Length))
+        {
+            tuple.set_int (Tuple::Length, length);
+            tuple.set_int (Tuple::Bitrate, index.bytes * 8 / length);
+            bitrate = index.bytes * 8000 / length;
+            set_playback_tuple (tuple.ref ());
+        }
+    };
+
+    bool index_tried = get_index (filename, file, false, index);
+    if (index_tried)
+        apply_index ();
+
     /* == FILL BUFFER == */
 
     unsigned char buf[BUFFER_SIZE];
@@ -411,8 +815,22 @@ bool AACDecoder::play (const char * filename, VFSFile & file)
 
         if (seek_value >= 0)
         {
+            if (! index_tried)
+            {
+                index_tried = true;
+
+                if (get_index (filename, file, true, index))
+                {
+                    apply_index ();
+                    set_stream_bitrate (bitrate);
+                }
+            }
+
             int length = tuple.get_int (Tuple::Length);
-            if (length > 0)
+            if (index.blocks)
+                discard = index_seek (file, decoder, index, seek_value,
+                 samplerate, buf, sizeof buf, & buflen);
+            else if (length > 0)
                 aac_seek (file, decoder, seek_value, length, buf, sizeof buf, & buflen);
         }
 
@@ -456,7 +874,21 @@ bool AACDecoder::play (const char * filename, VFSFile & file)
         /* == PLAY THE SOUND == */
 
         if (audio && info.samples)
-            write_audio (audio, sizeof (float) * info.samples);
+        {
+            float * data = (float *) audio;
+            int samples = info.samples;
+
+            if (discard > 0 && info.channels)
+            {
+                int skip = aud::min (discard * info.channels, (int64_t) samples);
+                data += skip;
+                samples -= skip;
+                discard -= skip / info.channels;
+            }
+
+            if (samples)
+                write_audio (data, sizeof (float) * samples);
+        }
     }
 
     NeAACDecClose (decoder);
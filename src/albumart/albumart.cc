@@ -24,6 +24,10 @@
 #include <libaudgui/libaudgui.h>
 #include <libaudgui/libaudgui-gtk.h>
 
+#include "../ui-common/art-thumb.h"
+
+#define ART_SIZE_STEP 128 /* requested sizes are rounded up to this */
+
 class AlbumArtPlugin : public GeneralPlugin
 {
 public:
@@ -42,26 +46,56 @@ public:
 
 EXPORT AlbumArtPlugin aud_plugin_instance;
 
-static void album_update (void *, GtkWidget * widget)
-{
-    AudguiPixbuf pixbuf = audgui_pixbuf_request_current ();
+static ArtThumbLoader<AudguiPixbuf> * loader;
+static int art_size; /* size of the last request, 0 if none */
 
+static void art_ready (AudguiPixbuf && pixbuf, void * widget)
+{
     if (! pixbuf)
         pixbuf = audgui_pixbuf_fallback ();
 
-    audgui_scaled_image_set (widget, pixbuf.get ());
+    audgui_scaled_image_set ((GtkWidget *) widget, pixbuf.get ());
+}
+
+static int wanted_size (GtkWidget * widget)
+{
+    GtkAllocation alloc;
+    gtk_widget_get_allocation (widget, & alloc);
+
+    int size = aud::max (aud::max (alloc.width, alloc.height), audgui_get_dpi ());
+    return (size + ART_SIZE_STEP - 1) / ART_SIZE_STEP * ART_SIZE_STEP;
+}
+
+static void album_update (void *, GtkWidget * widget)
+{
+    art_size = wanted_size (widget);
+    loader->request_current (art_size);
 }
 
 static void album_clear (void *, GtkWidget * widget)
 {
+    loader->cancel ();
+    art_size = 0;
+
     audgui_scaled_image_set (widget, nullptr);
 }
 
+/* the art is loaded to fit the widget; load it again if it has grown */
+static void album_resize (GtkWidget * widget)
+{
+    if (art_size && wanted_size (widget) > art_size)
+        album_update (nullptr, widget);
+}
+
 static void album_cleanup (GtkWidget * widget)
 {
     hook_dissociate ("playback ready", (HookFunction) album_update, widget);
     hook_dissociate ("playback stop", (HookFunction) album_clear, widget);
 
+    delete loader;
+    loader = nullptr;
+    art_size = 0;
+
     audgui_cleanup ();
 }
 
@@ -71,7 +105,10 @@ void * AlbumArtPlugin::get_gtk_widget ()
 
     GtkWidget * widget = audgui_scaled_image_new (nullptr);
 
+    loader = new ArtThumbLoader<AudguiPixbuf> (art_ready, widget);
+
     g_signal_connect (widget, "destroy", (GCallback) album_cleanup, nullptr);
+    g_signal_connect (widget, "size-allocate", (GCallback) album_resize, nullptr);
 
     hook_associate ("playback ready", (HookFunction) album_update, widget);
     hook_associate ("playback stop", (HookFunction) album_clear, widget);
@@ -35,6 +35,11 @@
  *   entering pause.)
  * * After setting the pump_quit flag, signal on alsa_cond AND the poll_pipe
  *   before joining the thread.
+ *
+ * In mmap mode there is no software buffer and no pump thread: write_audio()
+ * copies straight into the hardware buffer (snd_pcm_mmap_begin/commit), and
+ * period_wait() does the poll() itself.  The same locking rules apply; flush()
+ * and unpausing wake period_wait() through alsa_cond and the poll_pipe.
  */
 
 #include <assert.h>
@@ -42,6 +47,7 @@
 #include <poll.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -76,6 +82,8 @@ static int alsa_channels, alsa_rate;
 
 static RingBuf<char> alsa_buffer;
 static int alsa_period; /* milliseconds */
+static bool alsa_mmap;
+static snd_pcm_uframes_t alsa_period_frames;
 
 static bool alsa_prebuffer, alsa_paused;
 static int alsa_paused_delay; /* milliseconds */
@@ -116,9 +124,9 @@ static bool poll_setup ()
     return true;
 }
 
-static void poll_sleep ()
+static void poll_sleep (int timeout = -1)
 {
-    if (poll (poll_handles, poll_count, -1) < 0)
+    if (poll (poll_handles, poll_count, timeout) < 0)
     {
         AUDERR ("Failed to poll: %s.\n", strerror (errno));
         return;
@@ -242,7 +250,12 @@ static void pump_stop ()
 static void start_playback ()
 {
     AUDDBG ("Starting playback.\n");
-    CHECK (snd_pcm_prepare, alsa_handle);
+
+    /* in mmap mode the data is already in the hardware buffer */
+    if (alsa_mmap)
+        CHECK (snd_pcm_start, alsa_handle);
+    else
+        CHECK (snd_pcm_prepare, alsa_handle);
 
 FAILED:
     alsa_prebuffer = false;
@@ -258,6 +271,73 @@ FAILED:
     return aud::rescale ((int) delay, alsa_rate, 1000);
 }
 
+/* Copies interleaved frames into the hardware buffer.  Returns the number of
+ * frames written. */
+static int mmap_write_locked (const char * data, int frames)
+{
+    int written = 0;
+
+    while (written < frames)
+    {
+        const snd_pcm_channel_area_t * areas;
+        snd_pcm_uframes_t offset, size = frames - written;
+
+        CHECK (snd_pcm_mmap_begin, alsa_handle, & areas, & offset, & size);
+
+        if (! size)
+            break;
+
+        memcpy ((char *) areas[0].addr + (areas[0].first + offset * areas[0].step) / 8,
+         data + snd_pcm_frames_to_bytes (alsa_handle, written),
+         snd_pcm_frames_to_bytes (alsa_handle, size));
+
+        int committed;
+        CHECK_VAL (committed, snd_pcm_mmap_commit, alsa_handle, offset, size);
+
+        written += committed;
+
+        if (committed < (int) size)
+            break;
+    }
+
+FAILED:
+    return written;
+}
+
+static void mmap_period_wait_locked ()
+{
+    while (1)
+    {
+        int avail;
+        CHECK_VAL_RECOVER (avail, snd_pcm_avail_update, alsa_handle);
+
+        if (avail >= (int) alsa_period_frames)
+            return;
+
+        if (alsa_paused)
+        {
+            pthread_cond_wait (& alsa_cond, & alsa_mutex);
+            continue;
+        }
+
+        /* the buffer is full; start playback if we haven't yet (this also
+         * covers restarting after an underrun) */
+        if (snd_pcm_state (alsa_handle) == SND_PCM_STATE_PREPARED)
+        {
+            start_playback ();
+            continue;
+        }
+
+        /* the timeout guards against drivers whose poll() misbehaves */
+        pthread_mutex_unlock (& alsa_mutex);
+        poll_sleep (2 * aud::max (alsa_period, 1));
+        pthread_mutex_lock (& alsa_mutex);
+    }
+
+FAILED:
+    return;
+}
+
 bool ALSAPlugin::init ()
 {
     AUDDBG ("Initialize.\n");
@@ -313,7 +393,7 @@ static snd_pcm_format_t convert_aud_format (int aud_format)
 
 bool ALSAPlugin::open_audio (int aud_format, int rate, int channels, String & error)
 {
-    int total_buffer, hard_buffer, soft_buffer, buffer_frames;
+    int total_buffer, hard_buffer, soft_buffer, buffer_frames, period;
     unsigned useconds;
     int direction;
 
@@ -337,8 +417,19 @@ bool ALSAPlugin::open_audio (int aud_format, int rate, int channels, String & er
     snd_pcm_hw_params_t * params;
     snd_pcm_hw_params_alloca (& params);
     CHECK_STR (error, snd_pcm_hw_params_any, alsa_handle, params);
-    CHECK_STR (error, snd_pcm_hw_params_set_access, alsa_handle, params,
-     SND_PCM_ACCESS_RW_INTERLEAVED);
+
+    alsa_mmap = aud_get_bool ("alsa", "mmap");
+
+    if (alsa_mmap && snd_pcm_hw_params_set_access (alsa_handle, params,
+     SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0)
+    {
+        AUDINFO ("PCM device does not support mmap access.\n");
+        alsa_mmap = false;
+    }
+
+    if (! alsa_mmap)
+        CHECK_STR (error, snd_pcm_hw_params_set_access, alsa_handle, params,
+         SND_PCM_ACCESS_RW_INTERLEAVED);
 
     CHECK_STR (error, snd_pcm_hw_params_set_format, alsa_handle, params, format);
     CHECK_STR (error, snd_pcm_hw_params_set_channels, alsa_handle, params, channels);
@@ -348,14 +439,16 @@ bool ALSAPlugin::open_audio (int aud_format, int rate, int channels, String & er
     alsa_channels = channels;
     alsa_rate = rate;
 
+    /* in mmap mode, the whole buffer is in hardware */
     total_buffer = aud_get_int (nullptr, "output_buffer_size");
-    useconds = 1000 * aud::min (1000, total_buffer / 2);
+    useconds = 1000 * aud::min (1000, alsa_mmap ? total_buffer : total_buffer / 2);
     direction = 0;
     CHECK_STR (error, snd_pcm_hw_params_set_buffer_time_near, alsa_handle,
      params, & useconds, & direction);
     hard_buffer = useconds / 1000;
 
-    useconds = 1000 * (hard_buffer / 4);
+    period = aud_get_int ("alsa", "period");
+    useconds = 1000 * (period > 0 ? aud::min (period, hard_buffer / 2) : hard_buffer / 4);
     direction = 0;
     CHECK_STR (error, snd_pcm_hw_params_set_period_time_near, alsa_handle,
      params, & useconds, & direction);
@@ -363,12 +456,36 @@ bool ALSAPlugin::open_audio (int aud_format, int rate, int channels, String & er
 
     CHECK_STR (error, snd_pcm_hw_params, alsa_handle, params);
 
-    soft_buffer = aud::max (total_buffer / 2, total_buffer - hard_buffer);
-    AUDINFO ("Buffer: hardware %d ms, software %d ms, period %d ms.\n",
-     hard_buffer, soft_buffer, alsa_period);
+    if (alsa_mmap)
+    {
+        snd_pcm_uframes_t boundary;
+        snd_pcm_sw_params_t * sw_params;
+        snd_pcm_sw_params_alloca (& sw_params);
+
+        CHECK_STR (error, snd_pcm_hw_params_get_period_size, params,
+         & alsa_period_frames, & direction);
+        CHECK_STR (error, snd_pcm_sw_params_current, alsa_handle, sw_params);
+        CHECK_STR (error, snd_pcm_sw_params_get_boundary, sw_params, & boundary);
+
+        /* playback is started explicitly, once the buffer is full */
+        CHECK_STR (error, snd_pcm_sw_params_set_start_threshold, alsa_handle,
+         sw_params, boundary);
+        CHECK_STR (error, snd_pcm_sw_params_set_avail_min, alsa_handle,
+         sw_params, alsa_period_frames);
+        CHECK_STR (error, snd_pcm_sw_params, alsa_handle, sw_params);
+
+        AUDINFO ("Buffer: hardware %d ms (mmap), period %d ms.\n",
+         hard_buffer, alsa_period);
+    }
+    else
+    {
+        soft_buffer = aud::max (total_buffer / 2, total_buffer - hard_buffer);
+        AUDINFO ("Buffer: hardware %d ms, software %d ms, period %d ms.\n",
+         hard_buffer, soft_buffer, alsa_period);
 
-    buffer_frames = aud::rescale<int64_t> (soft_buffer, 1000, rate);
-    alsa_buffer.alloc (snd_pcm_frames_to_bytes (alsa_handle, buffer_frames));
+        buffer_frames = aud::rescale<int64_t> (soft_buffer, 1000, rate);
+        alsa_buffer.alloc (snd_pcm_frames_to_bytes (alsa_handle, buffer_frames));
+    }
 
     alsa_prebuffer = true;
     alsa_paused = false;
@@ -377,7 +494,8 @@ bool ALSAPlugin::open_audio (int aud_format, int rate, int channels, String & er
     if (! poll_setup ())
         goto FAILED;
 
-    pump_start ();
+    if (! alsa_mmap)
+        pump_start ();
 
     pthread_mutex_unlock (& alsa_mutex);
     return true;
@@ -400,7 +518,9 @@ void ALSAPlugin::close_audio ()
 
     assert (alsa_handle);
 
-    pump_stop ();
+    if (! alsa_mmap)
+        pump_stop ();
+
     CHECK (snd_pcm_drop, alsa_handle);
 
 FAILED:
@@ -416,20 +536,43 @@ int ALSAPlugin::write_audio (const void * data, int length)
 {
     pthread_mutex_lock (& alsa_mutex);
 
-    length = aud::min (length, alsa_buffer.space ());
-    alsa_buffer.copy_in ((const char *) data, length);
+    if (alsa_mmap)
+    {
+        int avail, frames;
+        CHECK_VAL_RECOVER (avail, snd_pcm_avail_update, alsa_handle);
 
-    if (! alsa_paused)
-        pthread_cond_broadcast (& alsa_cond);
+        frames = aud::min (avail, (int) snd_pcm_bytes_to_frames (alsa_handle, length));
+        frames = mmap_write_locked ((const char *) data, frames);
+        length = snd_pcm_frames_to_bytes (alsa_handle, frames);
+    }
+    else
+    {
+        length = aud::min (length, alsa_buffer.space ());
+        alsa_buffer.copy_in ((const char *) data, length);
+
+        if (! alsa_paused)
+            pthread_cond_broadcast (& alsa_cond);
+    }
 
     pthread_mutex_unlock (& alsa_mutex);
     return length;
+
+FAILED:
+    pthread_mutex_unlock (& alsa_mutex);
+    return 0;
 }
 
 void ALSAPlugin::period_wait ()
 {
     pthread_mutex_lock (& alsa_mutex);
 
+    if (alsa_mmap)
+    {
+        mmap_period_wait_locked ();
+        pthread_mutex_unlock (& alsa_mutex);
+        return;
+    }
+
     while (! alsa_buffer.space ())
     {
         if (! alsa_paused)
@@ -456,6 +599,25 @@ void ALSAPlugin::drain ()
     if (alsa_prebuffer)
         start_playback ();
 
+    if (alsa_mmap)
+    {
+        /* after an underrun, snd_pcm_recover() leaves the device prepared;
+         * it is only restarted once the buffer is full again, which a short
+         * tail at the end of the song may never do */
+        snd_pcm_sframes_t queued = 0;
+
+        if (snd_pcm_state (alsa_handle) == SND_PCM_STATE_PREPARED &&
+         snd_pcm_delay (alsa_handle, & queued) == 0 && queued > 0)
+            start_playback ();
+
+        int d = get_delay_locked ();
+        timespec delay = {d / 1000, d % 1000 * 1000000};
+
+        pthread_mutex_unlock (& alsa_mutex);
+        nanosleep (& delay, nullptr);
+        return;
+    }
+
     while (snd_pcm_bytes_to_frames (alsa_handle, alsa_buffer.len ()))
         pthread_cond_wait (& alsa_cond, & alsa_mutex);
 
@@ -477,10 +639,11 @@ int ALSAPlugin::get_delay ()
 {
     pthread_mutex_lock (& alsa_mutex);
 
-    int buffered = snd_pcm_bytes_to_frames (alsa_handle, alsa_buffer.len ());
+    int buffered = alsa_mmap ? 0 : snd_pcm_bytes_to_frames (alsa_handle, alsa_buffer.len ());
     int delay = aud::rescale (buffered, alsa_rate, 1000);
 
-    if (alsa_prebuffer || alsa_paused)
+    /* in mmap mode, data written before playback starts is in hardware */
+    if (alsa_mmap ? (alsa_paused && ! alsa_prebuffer) : (alsa_prebuffer || alsa_paused))
         delay += alsa_paused_delay;
     else
         delay += get_delay_locked ();
@@ -494,9 +657,15 @@ void ALSAPlugin::flush ()
     AUDDBG ("Seek requested; discarding buffer.\n");
     pthread_mutex_lock (& alsa_mutex);
 
-    pump_stop ();
+    if (! alsa_mmap)
+        pump_stop ();
+
     CHECK (snd_pcm_drop, alsa_handle);
 
+    /* ready the hardware buffer to be written again */
+    if (alsa_mmap)
+        CHECK (snd_pcm_prepare, alsa_handle);
+
 FAILED:
     alsa_buffer.discard ();
 
@@ -505,7 +674,10 @@ FAILED:
 
     pthread_cond_broadcast (& alsa_cond); /* interrupt period wait */
 
-    pump_start ();
+    if (alsa_mmap)
+        poll_wake ();
+    else
+        pump_start ();
 
     pthread_mutex_unlock (& alsa_mutex);
 }
@@ -527,8 +699,13 @@ void ALSAPlugin::pause (bool pause)
 
 DONE:
     if (! pause)
+    {
         pthread_cond_broadcast (& alsa_cond);
 
+        if (alsa_mmap)
+            poll_wake ();
+    }
+
     pthread_mutex_unlock (& alsa_mutex);
     return;
 
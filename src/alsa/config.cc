@@ -241,6 +241,8 @@ static void guess_element ()
 const char * const ALSAPlugin::defaults[] = {
     "pcm", "default",
     "mixer", "default",
+    "mmap", "FALSE",
+    "period", "0",
     nullptr
 };
 
@@ -301,7 +303,12 @@ const PreferencesWidget ALSAPlugin::widgets[] = {
         {nullptr, mixer_combo_fill}),
     WidgetCombo (N_("Mixer element:"),
         WidgetString ("alsa", "mixer-element", element_changed, "alsa mixer changed"),
-        {nullptr, element_combo_fill})
+        {nullptr, element_combo_fill}),
+    WidgetCheck (N_("Write directly to hardware buffer (mmap)"),
+        WidgetBool ("alsa", "mmap")),
+    WidgetSpin (N_("Period size:"),
+        WidgetInt ("alsa", "period"),
+        {0, 100, 1, N_("ms (0 = automatic)")})
 };
 
 static void alsa_prefs_init ()
@@ -26,6 +26,13 @@
 #include <math.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #include <gtk/gtk.h>
 
 #include <libaudcore/i18n.h>
@@ -33,6 +40,8 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/preferences.h>
 
+#include "../ui-common/worker-pool.h"
+
 static void /* GtkWidget */ * bscope_get_color_chooser ();
 
 static const PreferencesWidget bscope_widgets[] = {
@@ -70,10 +79,17 @@ public:
     void render_mono_pcm (const float * pcm);
 
 private:
+    /* range of columns in a row that may be non-zero; empty if lo >= hi */
+    struct Extent {
+        int lo, hi;
+    };
+
     void resize (int w, int h);
     void draw ();
 
     void blur ();
+    void blur_rows (int y1, int y2);
+    static void blur_part (int part, int parts, void * data);
     void draw_vert_line (int x, int y1, int y2);
 
     static gboolean configure_event (GtkWidget * widget, GdkEventConfigure * event, void * user);
@@ -81,11 +97,26 @@ private:
 
     GtkWidget * area = nullptr;
     int width = 0, height = 0, stride = 0, image_size = 0;
+
+    /* The blur reads one buffer and writes the other, so that rows can be
+     * processed independently (in parallel, and several pixels at a time).
+     * image/corner point to the buffer currently shown. */
+    uint32_t * images[2] = {nullptr, nullptr};
+    Extent * extents[2] = {nullptr, nullptr};
+    int cur = 0;
+
     uint32_t * image = nullptr, * corner = nullptr;
 };
 
 EXPORT BlurScope aud_plugin_instance;
 
+/* Large images are blurred in horizontal bands, one per thread of the
+ * pool; each band must have at least MIN_BAND_PIXELS pixels. */
+
+#define MIN_BAND_PIXELS (256 * 256)
+
+static WorkerPool pool;
+
 bool BlurScope::init ()
 {
     aud_config_set_defaults ("BlurScope", bscope_defaults);
@@ -98,8 +129,17 @@ void BlurScope::cleanup ()
 {
     aud_set_int ("BlurScope", "color", bscope_color);
 
-    g_free (image);
-    image = nullptr;
+    pool.stop ();
+
+    for (int i = 0; i < 2; i ++)
+    {
+        g_free (images[i]);
+        g_free (extents[i]);
+        images[i] = nullptr;
+        extents[i] = nullptr;
+    }
+
+    image = corner = nullptr;
 }
 
 void BlurScope::resize (int w, int h)
@@ -108,9 +148,14 @@ void BlurScope::resize (int w, int h)
     height = h;
     stride = width + 2;
     image_size = (stride << 2) * (height + 2);
-    image = (uint32_t *) g_realloc (image, image_size);
-    memset (image, 0, image_size);
-    corner = image + stride + 1;
+
+    for (int i = 0; i < 2; i ++)
+    {
+        images[i] = (uint32_t *) g_realloc (images[i], image_size);
+        extents[i] = g_renew (Extent, extents[i], height);
+    }
+
+    clear ();
 }
 
 void BlurScope::draw ()
@@ -155,27 +200,150 @@ void * BlurScope::get_gtk_widget ()
 
 void BlurScope::clear ()
 {
-    memset (image, 0, image_size);
+    for (int i = 0; i < 2; i ++)
+    {
+        if (images[i])
+            memset (images[i], 0, image_size);
+
+        for (int y = 0; y < height; y ++)
+            extents[i][y] = {width, 0};
+    }
+
+    cur = 0;
+    image = images[0];
+    corner = image ? image + stride + 1 : nullptr;
+
     draw ();
 }
 
+/* We do a quick and dirty average of four color values, first masking off the
+ * lowest two bits.  Over a large area, this masking has the net effect of
+ * subtracting 1.5 from each value, which by a happy chance is just right for a
+ * gradual fade effect.  The channels cannot overflow into one another, so four
+ * pixels can be summed at once in 32-bit lanes (a rounding byte average such as
+ * pavgb would never fade to black). */
+static void blur_span (const uint32_t * in, uint32_t * out, int n, int stride)
+{
+    int i = 0;
+
+#ifdef __AVX2__
+    const __m256i mask8 = _mm256_set1_epi32 (0xFCFCFC);
+
+    for (; i + 8 <= n; i += 8)
+    {
+        const uint32_t * p = in + i;
+        __m256i up = _mm256_loadu_si256 ((const __m256i *) (p - stride));
+        __m256i left = _mm256_loadu_si256 ((const __m256i *) (p - 1));
+        __m256i right = _mm256_loadu_si256 ((const __m256i *) (p + 1));
+        __m256i down = _mm256_loadu_si256 ((const __m256i *) (p + stride));
+
+        __m256i sum = _mm256_add_epi32
+         (_mm256_add_epi32 (_mm256_and_si256 (up, mask8), _mm256_and_si256 (left, mask8)),
+          _mm256_add_epi32 (_mm256_and_si256 (right, mask8), _mm256_and_si256 (down, mask8)));
+
+        _mm256_storeu_si256 ((__m256i *) (out + i), _mm256_srli_epi32 (sum, 2));
+    }
+#endif
+
+#ifdef __SSE2__
+    const __m128i mask4 = _mm_set1_epi32 (0xFCFCFC);
+
+    for (; i + 4 <= n; i += 4)
+    {
+        const uint32_t * p = in + i;
+        __m128i up = _mm_loadu_si128 ((const __m128i *) (p - stride));
+        __m128i left = _mm_loadu_si128 ((const __m128i *) (p - 1));
+        __m128i right = _mm_loadu_si128 ((const __m128i *) (p + 1));
+        __m128i down = _mm_loadu_si128 ((const __m128i *) (p + stride));
+
+        __m128i sum = _mm_add_epi32
+         (_mm_add_epi32 (_mm_and_si128 (up, mask4), _mm_and_si128 (left, mask4)),
+          _mm_add_epi32 (_mm_and_si128 (right, mask4), _mm_and_si128 (down, mask4)));
+
+        _mm_storeu_si128 ((__m128i *) (out + i), _mm_srli_epi32 (sum, 2));
+    }
+#endif
+
+    for (; i < n; i ++)
+    {
+        const uint32_t * p = in + i;
+        out[i] = ((p[-stride] & 0xFCFCFC) + (p[-1] & 0xFCFCFC) + (p[1] &
+         0xFCFCFC) + (p[stride] & 0xFCFCFC)) >> 2;
+    }
+}
+
+static inline void add_extent (int & lo, int & hi, int e_lo, int e_hi, int grow)
+{
+    if (e_lo < e_hi)
+    {
+        lo = aud::min (lo, e_lo - grow);
+        hi = aud::max (hi, e_hi + grow);
+    }
+}
+
+/* Only the columns next to non-zero pixels in the source are computed, so
+ * fully decayed regions cost nothing. */
+void BlurScope::blur_rows (int y1, int y2)
+{
+    const uint32_t * src = images[cur] + stride + 1;
+    uint32_t * dest = images[cur ^ 1] + stride + 1;
+    const Extent * src_ext = extents[cur];
+    Extent * dest_ext = extents[cur ^ 1];
+
+    for (int y = y1; y < y2; y ++)
+    {
+        uint32_t * out = dest + stride * y;
+        Extent & ext = dest_ext[y];
+
+        if (ext.lo < ext.hi)
+            memset (out + ext.lo, 0, sizeof (uint32_t) * (ext.hi - ext.lo));
+
+        int lo = width, hi = 0;
+        add_extent (lo, hi, src_ext[y].lo, src_ext[y].hi, 1);
+        if (y > 0)
+            add_extent (lo, hi, src_ext[y - 1].lo, src_ext[y - 1].hi, 0);
+        if (y < height - 1)
+            add_extent (lo, hi, src_ext[y + 1].lo, src_ext[y + 1].hi, 0);
+
+        lo = aud::max (lo, 0);
+        hi = aud::min (hi, width);
+
+        if (lo < hi)
+        {
+            blur_span (src + stride * y + lo, out + lo, hi - lo, stride);
+
+            while (lo < hi && ! out[lo])
+                lo ++;
+            while (hi > lo && ! out[hi - 1])
+                hi --;
+        }
+
+        ext = (lo < hi) ? Extent {lo, hi} : Extent {width, 0};
+    }
+}
+
+void BlurScope::blur_part (int part, int parts, void * data)
+{
+    BlurScope & scope = * (BlurScope *) data;
+    int bands = aud::min (parts, scope.width * scope.height / MIN_BAND_PIXELS);
+
+    if (part < bands)
+        scope.blur_rows (scope.height * part / bands, scope.height * (part + 1) / bands);
+}
+
 void BlurScope::blur ()
 {
-    for (int y = 0; y < height; y ++)
+    if (width * height >= 2 * MIN_BAND_PIXELS)
     {
-        uint32_t * p = corner + stride * y;
-        uint32_t * end = p + width;
-        uint32_t * plast = p - stride;
-        uint32_t * pnext = p + stride;
-
-        /* We do a quick and dirty average of four color values, first masking
-         * off the lowest two bits.  Over a large area, this masking has the net
-         * effect of subtracting 1.5 from each value, which by a happy chance
-         * is just right for a gradual fade effect. */
-        for (; p < end; p ++)
-            * p = ((* plast ++ & 0xFCFCFC) + (p[-1] & 0xFCFCFC) + (p[1] &
-             0xFCFCFC) + (* pnext ++ & 0xFCFCFC)) >> 2;
+        pool.start ();
+        pool.run (blur_part, this);
     }
+    else
+        blur_rows (0, height);
+
+    cur ^= 1;
+    image = images[cur];
+    corner = image + stride + 1;
 }
 
 void BlurScope::draw_vert_line (int x, int y1, int y2)
@@ -187,13 +355,27 @@ void BlurScope::draw_vert_line (int x, int y1, int y2)
     else {y = y1; h = 1;}
 
     uint32_t * p = corner + y * stride + x;
+    Extent * ext = extents[cur] + y;
 
-    for (; h --; p += stride)
+    for (; h --; p += stride, ext ++)
+    {
         * p = bscope_color;
+
+        if (ext->lo >= ext->hi)
+            * ext = {x, x + 1};
+        else
+        {
+            ext->lo = aud::min (ext->lo, x);
+            ext->hi = aud::max (ext->hi, x + 1);
+        }
+    }
 }
 
 void BlurScope::render_mono_pcm (const float * pcm)
 {
+    if (! image)
+        return;
+
     blur ();
 
     int prev_y = (0.5 + pcm[0]) * height;
@@ -0,0 +1 @@
+#include "../ui-common/worker-pool.cc"
@@ -22,10 +22,14 @@
  */
 
 #include <math.h>
+#include <stdint.h>
 #include <string.h>
 
+#include <glib.h>
+
 #include <libaudcore/i18n.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/runtime.h>
 
 #include <gdk/gdk.h>
 #include <gtk/gtk.h>
@@ -41,6 +45,8 @@
 #include <gdk/gdkwin32.h>
 #endif
 
+#include "../ui-common/band-map.h"
+
 #define NUM_BANDS 32
 #define DB_RANGE 40
 
@@ -78,7 +84,7 @@ public:
 
 EXPORT GLSpectrum aud_plugin_instance;
 
-static float logscale[NUM_BANDS + 1];
+static BandMap band_map;
 static float colors[NUM_BANDS][NUM_BANDS][3];
 
 #ifdef GDK_WINDOWING_X11
@@ -99,10 +105,11 @@ static int s_pos = 0;
 static float s_angle = 25, s_anglespeed = 0.05f;
 static float s_bars[NUM_BANDS][NUM_BANDS];
 
+static void update_row (int slot);
+
 bool GLSpectrum::init ()
 {
-    for (int i = 0; i <= NUM_BANDS; i ++)
-        logscale[i] = powf (256, (float) i / NUM_BANDS) - 0.5f;
+    band_map.set_bands (NUM_BANDS);
 
     for (int y = 0; y < NUM_BANDS; y ++)
     {
@@ -118,42 +125,22 @@ bool GLSpectrum::init ()
         }
     }
 
+    for (int i = 0; i < NUM_BANDS; i ++)
+        update_row (i);
+
     return true;
 }
 
-/* stolen from the skins plugin */
 /* convert linear frequency graph to logarithmic one */
 static void make_log_graph (const float * freq, float * graph)
 {
+    float db[NUM_BANDS];
+    band_map.compute_db (freq, db);
+
     for (int i = 0; i < NUM_BANDS; i ++)
     {
-        /* sum up values in freq array between logscale[i] and logscale[i + 1],
-           including fractional parts */
-        int a = ceilf (logscale[i]);
-        int b = floorf (logscale[i + 1]);
-        float sum = 0;
-
-        if (b < a)
-            sum += freq[b] * (logscale[i + 1] - logscale[i]);
-        else
-        {
-            if (a > 0)
-                sum += freq[a - 1] * (a - logscale[i]);
-            for (; a < b; a ++)
-                sum += freq[a];
-            if (b < 256)
-                sum += freq[b] * (logscale[i + 1] - b);
-        }
-
-        /* fudge factor to make the graph have the same overall height as a
-           12-band one no matter how many bands there are */
-        sum *= (float) NUM_BANDS / 12;
-
-        /* convert to dB */
-        float val = 20 * log10f (sum);
-
         /* scale (-DB_RANGE, 0.0) to (0.0, 1.0) */
-        val = 1 + val / DB_RANGE;
+        float val = 1 + db[i] / DB_RANGE;
 
         graph[i] = aud::clamp (val, 0.0f, 1.0f);
     }
@@ -162,6 +149,7 @@ static void make_log_graph (const float * freq, float * graph)
 void GLSpectrum::render_freq (const float * freq)
 {
     make_log_graph (freq, s_bars[s_pos]);
+    update_row (s_pos);
     s_pos = (s_pos + 1) % NUM_BANDS;
 
     s_angle += s_anglespeed;
@@ -176,76 +164,145 @@ void GLSpectrum::clear ()
 {
     memset (s_bars, 0, sizeof s_bars);
 
+    for (int i = 0; i < NUM_BANDS; i ++)
+        update_row (i);
+
     if (s_widget)
         gtk_widget_queue_draw (s_widget);
 }
 
-static void draw_rectangle (float x1, float y1, float z1, float x2, float y2,
- float z2, float r, float g, float b)
+/* The bar geometry is kept in vertex arrays, one row of bars per slot of the
+ * s_bars ring buffer.  The x/z footprint of each bar never changes, so only
+ * the heights of the newest row are rewritten per frame; the rows are moved
+ * into place by age with two translated draw calls.  Colors depend on the
+ * age of a row and are refilled each frame. */
+
+#define VERTS_PER_BAR 16
+#define VERTS_PER_ROW (NUM_BANDS * VERTS_PER_BAR)
+
+static float s_vertices[NUM_BANDS][VERTS_PER_ROW][3];
+static float s_colors[NUM_BANDS][VERTS_PER_ROW][3];
+
+/* top, left, right, front faces */
+static const float s_shades[VERTS_PER_BAR] = {
+    1, 1, 1, 1,
+    0.65f, 0.65f, 0.65f, 0.65f,
+    0.65f, 0.65f, 0.65f, 0.65f,
+    0.8f, 0.8f, 0.8f, 0.8f
+};
+
+static void set_vertex (float * v, float x, float y, float z)
+{
+    v[0] = x;
+    v[1] = y;
+    v[2] = z;
+}
+
+static void set_bar_vertices (float (* v)[3], float x1, float z1, float h)
+{
+    float x2 = x1 + BAR_WIDTH, z2 = z1 + BAR_WIDTH;
+    float y1 = 0, y2 = h;
+
+    set_vertex (v[0], x1, y2, z1);
+    set_vertex (v[1], x2, y2, z1);
+    set_vertex (v[2], x2, y2, z2);
+    set_vertex (v[3], x1, y2, z2);
+
+    set_vertex (v[4], x1, y1, z1);
+    set_vertex (v[5], x1, y2, z1);
+    set_vertex (v[6], x1, y2, z2);
+    set_vertex (v[7], x1, y1, z2);
+
+    set_vertex (v[8], x2, y2, z1);
+    set_vertex (v[9], x2, y1, z1);
+    set_vertex (v[10], x2, y1, z2);
+    set_vertex (v[11], x2, y2, z2);
+
+    set_vertex (v[12], x1, y1, z1);
+    set_vertex (v[13], x2, y1, z1);
+    set_vertex (v[14], x2, y2, z1);
+    set_vertex (v[15], x1, y2, z1);
+}
+
+/* rows are laid out as if s_pos were 0; draw_bars() shifts them */
+static void update_row (int slot)
 {
-    glColor3f (r, g, b);
-
-    glBegin (GL_POLYGON);
-    glVertex3f (x1, y2, z1);
-    glVertex3f (x2, y2, z1);
-    glVertex3f (x2, y2, z2);
-    glVertex3f (x1, y2, z2);
-    glEnd ();
-
-    glColor3f (0.65f * r, 0.65f * g, 0.65f * b);
-
-    glBegin (GL_POLYGON);
-    glVertex3f (x1, y1, z1);
-    glVertex3f (x1, y2, z1);
-    glVertex3f (x1, y2, z2);
-    glVertex3f (x1, y1, z2);
-    glEnd ();
-
-    glBegin (GL_POLYGON);
-    glVertex3f (x2, y2, z1);
-    glVertex3f (x2, y1, z1);
-    glVertex3f (x2, y1, z2);
-    glVertex3f (x2, y2, z2);
-    glEnd ();
-
-    glColor3f (0.8f * r, 0.8f * g, 0.8f * b);
-
-    glBegin (GL_POLYGON);
-    glVertex3f (x1, y1, z1);
-    glVertex3f (x2, y1, z1);
-    glVertex3f (x2, y2, z1);
-    glVertex3f (x1, y2, z1);
-    glEnd ();
+    float z = -1.6f + (NUM_BANDS - slot) * BAR_SPACING;
+
+    for (int j = 0; j < NUM_BANDS; j ++)
+        set_bar_vertices (& s_vertices[slot][j * VERTS_PER_BAR],
+         1.6f - BAR_SPACING * j, z, s_bars[slot][j] * 1.6f);
 }
 
-static void draw_bar (float x, float z, float h, float r, float g, float b)
+static void update_colors ()
 {
-    draw_rectangle (x, 0, z, x + BAR_WIDTH, h, z + BAR_WIDTH,
-     r * (0.2f + 0.8f * h), g * (0.2f + 0.8f * h), b * (0.2f + 0.8f * h));
+    for (int slot = 0; slot < NUM_BANDS; slot ++)
+    {
+        int age = (slot - s_pos + NUM_BANDS) % NUM_BANDS;
+
+        for (int j = 0; j < NUM_BANDS; j ++)
+        {
+            float h = s_bars[slot][j] * 1.6f;
+            float bright = 0.2f + 0.8f * h;
+            float (* c)[3] = & s_colors[slot][j * VERTS_PER_BAR];
+
+            for (int v = 0; v < VERTS_PER_BAR; v ++)
+            {
+                float shade = s_shades[v] * bright;
+                c[v][0] = colors[age][j][0] * shade;
+                c[v][1] = colors[age][j][1] * shade;
+                c[v][2] = colors[age][j][2] * shade;
+            }
+        }
+    }
 }
 
 static void draw_bars ()
 {
+    update_colors ();
+
     glPushMatrix ();
     glTranslatef (0.0f, -0.5f, -5.0f);
     glRotatef (38.0f, 1.0f, 0.0f, 0.0f);
     glRotatef (s_angle + 180.0f, 0.0f, 1.0f, 0.0f);
+    glEnableClientState (GL_VERTEX_ARRAY);
+    glEnableClientState (GL_COLOR_ARRAY);
+    glVertexPointer (3, GL_FLOAT, 0, s_vertices);
+    glColorPointer (3, GL_FLOAT, 0, s_colors);
 
-    for (int i = 0; i < NUM_BANDS; i ++)
-    {
-        float z = -1.6f + (NUM_BANDS - i) * BAR_SPACING;
+    /* rows from s_pos onward are the oldest */
+    glTranslatef (0.0f, 0.0f, s_pos * BAR_SPACING);
+    glDrawArrays (GL_QUADS, s_pos * VERTS_PER_ROW, (NUM_BANDS - s_pos) * VERTS_PER_ROW);
 
-        for (int j = 0; j < NUM_BANDS; j ++)
-        {
-            draw_bar (1.6f - BAR_SPACING * j, z,
-             s_bars[(s_pos + i) % NUM_BANDS][j] * 1.6,
-             colors[i][j][0], colors[i][j][1], colors[i][j][2]);
-        }
+    if (s_pos > 0)
+    {
+        glTranslatef (0.0f, 0.0f, -NUM_BANDS * BAR_SPACING);
+        glDrawArrays (GL_QUADS, 0, s_pos * VERTS_PER_ROW);
     }
 
+    glDisableClientState (GL_COLOR_ARRAY);
+    glDisableClientState (GL_VERTEX_ARRAY);
     glPopMatrix ();
 }
 
+/* frame time counter, reported at debug level every FRAME_REPORT frames */
+#define FRAME_REPORT 100
+
+static int64_t s_frame_time;
+static int s_frames;
+
+static void frame_done (int64_t start)
+{
+    s_frame_time += g_get_monotonic_time () - start;
+
+    if (++ s_frames == FRAME_REPORT)
+    {
+        AUDDBG ("Average frame time: %d us.\n", (int) (s_frame_time / s_frames));
+        s_frame_time = 0;
+        s_frames = 0;
+    }
+}
+
 static gboolean draw_cb (GtkWidget * widget)
 {
 #ifdef GDK_WINDOWING_X11
@@ -258,6 +315,8 @@ static gboolean draw_cb (GtkWidget * widget)
         return false;
 #endif
 
+    int64_t start = g_get_monotonic_time ();
+
     glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     draw_bars ();
@@ -270,6 +329,8 @@ static gboolean draw_cb (GtkWidget * widget)
     SwapBuffers (s_hdc);
 #endif
 
+    frame_done (start);
+
     return true;
 }
 
@@ -29,6 +29,8 @@
 
 #include "ui_infoarea.h"
 
+#include "../ui-common/art-thumb.h"
+
 #define VIS_BANDS 12
 #define VIS_DELAY 2 /* delay before falloff in frames */
 #define VIS_FALLOFF 2 /* falloff in decibels per frame */
@@ -49,12 +51,15 @@ static void compute_sizes ()
     VIS_CENTER = VIS_SCALE + SPACING;
 }
 
+static void art_ready (AudguiPixbuf && pb, void *);
+
 typedef struct {
     GtkWidget * box, * main;
 
     String title, artist, album;
     String last_title, last_artist, last_album;
     AudguiPixbuf pb, last_pb;
+    ArtThumbLoader<AudguiPixbuf> art {art_ready, nullptr};
     float alpha, last_alpha;
 
     bool stopped;
@@ -404,16 +409,24 @@ static void ui_infoarea_set_title ()
     gtk_widget_queue_draw (area->main);
 }
 
-static void set_album_art ()
+static void art_ready (AudguiPixbuf && pb, void *)
 {
     g_return_if_fail (area);
 
-    area->pb = audgui_pixbuf_request_current ();
-
-    if (area->pb)
-        audgui_pixbuf_scale_within (area->pb, ICON_SIZE);
+    if (pb)
+        area->pb = std::move (pb);
     else
         area->pb = audgui_pixbuf_fallback ();
+
+    gtk_widget_queue_draw (area->main);
+}
+
+/* the art is decoded in the background and shown when it is ready */
+static void set_album_art ()
+{
+    g_return_if_fail (area);
+
+    area->art.request_current (ICON_SIZE);
 }
 
 static void infoarea_next ()
@@ -449,6 +462,7 @@ static void ui_infoarea_playback_stop ()
 {
     g_return_if_fail (area);
 
+    area->art.cancel ();
     infoarea_next ();
     area->stopped = true;
 
@@ -89,111 +89,145 @@ static const bool pw_col_label[PW_COLS] = {
     true    // comment
 };
 
+/* The decoded column values of recently drawn rows are cached, so that
+ * drawing a row costs only one tuple lookup regardless of the number of
+ * columns.  The cache is direct-mapped by row number; since the rows on
+ * screen are contiguous, they never evict one another as long as fewer than
+ * ROW_CACHE_SIZE rows are visible. */
+
+#define ROW_CACHE_SIZE 256
+
+struct CachedRow
+{
+    int row = -1;
+    String values[PW_COLS];
+};
+
 struct PlaylistWidgetData
 {
     Playlist list;
     int popup_pos = -1;
     QueuedFunc popup_timer;
 
+    CachedRow row_cache[ROW_CACHE_SIZE];
+    int64_t draw_start = 0;
+
     void show_popup ()
         { audgui_infopopup_show (list, popup_pos); }
 };
 
-static void set_int_from_tuple (GValue * value, const Tuple & tuple, Tuple::Field field)
+static String int_from_tuple (const Tuple & tuple, Tuple::Field field)
 {
     int i = tuple.get_int (field);
-    if (i > 0)
-        g_value_take_string (value, g_strdup_printf ("%d", i));
-    else
-        g_value_set_string (value, "");
+    return (i > 0) ? String (int_to_str (i)) : String ("");
 }
 
-static void set_string_from_tuple (GValue * value, const Tuple & tuple, Tuple::Field field)
-{
-    g_value_set_string (value, tuple.get_str (field));
-}
-
-static void set_queued (GValue * value, Playlist list, int row)
+static String queued_from_list (Playlist list, int row)
 {
     int q = list.queue_find_entry (row);
-    if (q < 0)
-        g_value_set_string (value, "");
-    else
-        g_value_take_string (value, g_strdup_printf ("#%d", 1 + q));
+    return (q < 0) ? String ("") : String (str_printf ("#%d", 1 + q));
 }
 
-static void set_length (GValue * value, const Tuple & tuple)
+static String length_from_tuple (const Tuple & tuple)
 {
     int len = tuple.get_int (Tuple::Length);
-    if (len >= 0)
-        g_value_set_string (value, str_format_time (len));
-    else
-        g_value_set_string (value, "");
+    return (len >= 0) ? String (str_format_time (len)) : String ("");
 }
 
-static void get_value (void * user, int row, int column, GValue * value)
+static String column_from_tuple (const Tuple & tuple, Playlist list, int row, int column)
 {
-    PlaylistWidgetData * data = (PlaylistWidgetData *) user;
-    g_return_if_fail (column >= 0 && column < pw_num_cols);
-    g_return_if_fail (row >= 0 && row < data->list.n_entries ());
-
-    column = pw_cols[column];
-
-    Tuple tuple;
-
-    if (column != PW_COL_NUMBER && column != PW_COL_QUEUED)
-        tuple = data->list.entry_tuple (row, Playlist::NoWait);
-
     switch (column)
     {
-    case PW_COL_NUMBER:
-        g_value_set_int (value, 1 + row);
-        break;
     case PW_COL_TITLE:
-        set_string_from_tuple (value, tuple, Tuple::Title);
-        break;
+        return tuple.get_str (Tuple::Title);
     case PW_COL_ARTIST:
-        set_string_from_tuple (value, tuple, Tuple::Artist);
-        break;
+        return tuple.get_str (Tuple::Artist);
     case PW_COL_YEAR:
-        set_int_from_tuple (value, tuple, Tuple::Year);
-        break;
+        return int_from_tuple (tuple, Tuple::Year);
     case PW_COL_ALBUM:
-        set_string_from_tuple (value, tuple, Tuple::Album);
-        break;
+        return tuple.get_str (Tuple::Album);
     case PW_COL_ALBUM_ARTIST:
-        set_string_from_tuple (value, tuple, Tuple::AlbumArtist);
-        break;
+        return tuple.get_str (Tuple::AlbumArtist);
     case PW_COL_TRACK:
-        set_int_from_tuple (value, tuple, Tuple::Track);
-        break;
+        return int_from_tuple (tuple, Tuple::Track);
     case PW_COL_GENRE:
-        set_string_from_tuple (value, tuple, Tuple::Genre);
-        break;
+        return tuple.get_str (Tuple::Genre);
     case PW_COL_QUEUED:
-        set_queued (value, data->list, row);
-        break;
+        return queued_from_list (list, row);
     case PW_COL_LENGTH:
-        set_length (value, tuple);
-        break;
+        return length_from_tuple (tuple);
     case PW_COL_FILENAME:
-        set_string_from_tuple (value, tuple, Tuple::Basename);
-        break;
+        return tuple.get_str (Tuple::Basename);
     case PW_COL_PATH:
-        set_string_from_tuple (value, tuple, Tuple::Path);
-        break;
+        return tuple.get_str (Tuple::Path);
     case PW_COL_CUSTOM:
-        set_string_from_tuple (value, tuple, Tuple::FormattedTitle);
-        break;
+        return tuple.get_str (Tuple::FormattedTitle);
     case PW_COL_BITRATE:
-        set_int_from_tuple (value, tuple, Tuple::Bitrate);
-        break;
+        return int_from_tuple (tuple, Tuple::Bitrate);
     case PW_COL_COMMENT:
-        set_string_from_tuple (value, tuple, Tuple::Comment);
-        break;
+        return tuple.get_str (Tuple::Comment);
+    default:
+        return String ();
     }
 }
 
+static const CachedRow & get_cached_row (PlaylistWidgetData * data, int row)
+{
+    CachedRow & cached = data->row_cache[row % ROW_CACHE_SIZE];
+    if (cached.row == row)
+        return cached;
+
+    Tuple tuple = data->list.entry_tuple (row, Playlist::NoWait);
+
+    for (auto & value : cached.values)
+        value = String ();
+
+    for (int i = 0; i < pw_num_cols; i ++)
+    {
+        int column = pw_cols[i];
+        cached.values[column] = column_from_tuple (tuple, data->list, row, column);
+    }
+
+    /* always needed by search_cb */
+    for (int column : {PW_COL_TITLE, PW_COL_ARTIST, PW_COL_ALBUM})
+        cached.values[column] = column_from_tuple (tuple, data->list, row, column);
+
+    cached.row = row;
+    return cached;
+}
+
+static void invalidate_rows (PlaylistWidgetData * data, int row, int count)
+{
+    if (count >= ROW_CACHE_SIZE)
+    {
+        for (auto & cached : data->row_cache)
+            cached.row = -1;
+
+        return;
+    }
+
+    for (int i = row; i < row + count; i ++)
+    {
+        CachedRow & cached = data->row_cache[i % ROW_CACHE_SIZE];
+        if (cached.row == i)
+            cached.row = -1;
+    }
+}
+
+static void get_value (void * user, int row, int column, GValue * value)
+{
+    PlaylistWidgetData * data = (PlaylistWidgetData *) user;
+    g_return_if_fail (column >= 0 && column < pw_num_cols);
+    g_return_if_fail (row >= 0 && row < data->list.n_entries ());
+
+    column = pw_cols[column];
+
+    if (column == PW_COL_NUMBER)
+        g_value_set_int (value, 1 + row);
+    else
+        g_value_set_string (value, get_cached_row (data, row).values[column]);
+}
+
 static bool get_selected (void * user, int row)
 {
     return ((PlaylistWidgetData *) user)->list.entry_selected (row);
@@ -320,22 +354,22 @@ static gboolean search_cb (GtkTreeModel * model, int column, const char * search
 
     if (keys.len ())
     {
-        auto list = ((PlaylistWidgetData *) user)->list;
-        Tuple tuple = list.entry_tuple (row);
+        auto data = (PlaylistWidgetData *) user;
+        const CachedRow & cached = get_cached_row (data, row);
 
-        String strings[3] = {
-            tuple.get_str (Tuple::Title),
-            tuple.get_str (Tuple::Artist),
-            tuple.get_str (Tuple::Album)
+        const String * strings[3] = {
+            & cached.values[PW_COL_TITLE],
+            & cached.values[PW_COL_ARTIST],
+            & cached.values[PW_COL_ALBUM]
         };
 
-        for (const String & s : strings)
+        for (const String * s : strings)
         {
-            if (! s)
+            if (! * s)
                 continue;
 
             auto is_match = [&] (const String & key)
-                { return (bool) strstr_nocase_utf8 (s, key); };
+                { return (bool) strstr_nocase_utf8 (* s, key); };
 
             keys.remove_if (is_match);
         }
@@ -351,6 +385,20 @@ static void destroy_cb (PlaylistWidgetData * data)
     delete data;
 }
 
+/* logs the time taken to redraw the list (e.g. while scrolling) */
+static gboolean expose_start_cb (GtkWidget *, GdkEventExpose *, PlaylistWidgetData * data)
+{
+    data->draw_start = g_get_monotonic_time ();
+    return false;
+}
+
+static gboolean expose_end_cb (GtkWidget *, GdkEventExpose *, PlaylistWidgetData * data)
+{
+    AUDDBG ("Playlist redraw took %d us.\n",
+     (int) (g_get_monotonic_time () - data->draw_start));
+    return false;
+}
+
 GtkWidget * ui_playlist_widget_new (Playlist playlist)
 {
     PlaylistWidgetData * data = new PlaylistWidgetData;
@@ -364,6 +412,8 @@ GtkWidget * ui_playlist_widget_new (Playlist playlist)
     gtk_tree_view_set_search_equal_func ((GtkTreeView *) list, search_cb, data,
      nullptr);
     g_signal_connect_swapped (list, "destroy", (GCallback) destroy_cb, data);
+    g_signal_connect (list, "expose-event", (GCallback) expose_start_cb, data);
+    g_signal_connect_after (list, "expose-event", (GCallback) expose_end_cb, data);
 
     /* Disable type-to-search because it blocks CTRL-V, causing URI's to be
      * pasted into the search box rather than added to the playlist.  The search
@@ -398,6 +448,9 @@ void ui_playlist_widget_update (GtkWidget * widget)
         int old_entries = audgui_list_row_count (widget);
         int removed = old_entries - update.before - update.after;
 
+        /* rows after the change have moved */
+        invalidate_rows (data, update.before, entries - update.before);
+
         audgui_list_delete_rows (widget, update.before, removed);
         audgui_list_insert_rows (widget, update.before, changed);
 
@@ -409,7 +462,10 @@ void ui_playlist_widget_update (GtkWidget * widget)
         ui_playlist_widget_scroll (widget);
     }
     else if (update.level == Playlist::Metadata || update.queue_changed)
+    {
+        invalidate_rows (data, update.before, changed);
         audgui_list_update_rows (widget, update.before, changed);
+    }
 
     if (update.queue_changed)
     {
@@ -417,7 +473,10 @@ void ui_playlist_widget_update (GtkWidget * widget)
         {
             int entry = data->list.queue_get_entry (i);
             if (entry < update.before || entry >= entries - update.after)
+            {
+                invalidate_rows (data, entry, 1);
                 audgui_list_update_rows (widget, entry, 1);
+            }
         }
     }
 
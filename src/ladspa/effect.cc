@@ -18,13 +18,45 @@
  */
 
 #include <assert.h>
+#include <time.h>
 
 #include "ladspa.h"
 #include "plugin.h"
 
 #include <libaudcore/runtime.h>
 
+#include "../ui-common/worker-pool.h"
+
+/* Audio is kept planar for the whole chain: it is de-interleaved once into
+ * chain_bufs[0], each plugin reads from one buffer and writes into the other,
+ * and only the final result is re-interleaved.  Instances of a plugin that
+ * process different channels (e.g. a mono plugin on stereo audio) are
+ * independent of one another and are spread over a small pool of worker
+ * threads. */
+
 static int ladspa_channels, ladspa_rate;
+static Index<float> chain_bufs[2];
+static WorkerPool pool;
+
+struct RunJob {
+    LoadedPlugin * loaded;
+    int frames;
+};
+
+static void run_instances (int part, int parts, void * data)
+{
+    auto job = (const RunJob *) data;
+    const LADSPA_Descriptor & desc = * job->loaded->plugin.desc;
+    int instances = job->loaded->instances.len ();
+
+    for (int i = part; i < instances; i += parts)
+        desc.run (job->loaded->instances[i], job->frames);
+}
+
+void stop_workers ()
+{
+    pool.stop ();
+}
 
 static void start_plugin (LoadedPlugin & loaded)
 {
@@ -34,28 +66,26 @@ static void start_plugin (LoadedPlugin & loaded)
     loaded.active = 1;
 
     PluginData & plugin = loaded.plugin;
-    const LADSPA_Descriptor & desc = plugin.desc;
+    const LADSPA_Descriptor & desc = * plugin.desc;
 
     int ports = plugin.in_ports.len ();
 
     if (ports == 0 || ports != plugin.out_ports.len ())
     {
-        AUDERR ("Plugin has unusable port configuration: %s\n", desc.Name);
+        AUDERR ("Plugin has unusable port configuration: %s\n", (const char *) plugin.name);
         return;
     }
 
     if (ladspa_channels % ports != 0)
     {
         AUDERR ("Plugin cannot be used with %d channels: %s\n",
-         ladspa_channels, desc.Name);
+         ladspa_channels, (const char *) plugin.name);
         return;
     }
 
     int instances = ladspa_channels / ports;
 
-    loaded.in_bufs.insert (0, ladspa_channels);
-    loaded.out_bufs.insert (0, ladspa_channels);
-
+    /* audio ports are connected to the chain buffers in run_plugin() */
     for (int i = 0; i < instances; i ++)
     {
         LADSPA_Handle handle = desc.instantiate (& desc, ladspa_rate);
@@ -65,77 +95,109 @@ static void start_plugin (LoadedPlugin & loaded)
         for (int c = 0; c < controls; c ++)
             desc.connect_port (handle, plugin.controls[c].port, & loaded.values[c]);
 
-        for (int p = 0; p < ports; p ++)
-        {
-            int channel = ports * i + p;
-
-            Index<float> & in = loaded.in_bufs[channel];
-            in.insert (0, LADSPA_BUFLEN);
-            desc.connect_port (handle, plugin.in_ports[p], in.begin ());
-
-            Index<float> & out = loaded.out_bufs[channel];
-            out.insert (0, LADSPA_BUFLEN);
-            desc.connect_port (handle, plugin.out_ports[p], out.begin ());
-        }
-
         if (desc.activate)
             desc.activate (handle);
     }
+
+    if (instances > 1)
+        pool.start ();
+}
+
+static int64_t time_ns ()
+{
+    timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
-static void run_plugin (LoadedPlugin & loaded, float * data, int samples)
+/* returns false if the plugin is inactive and did not touch the buffers */
+static bool run_plugin (LoadedPlugin & loaded, const float * in, float * out, int frames)
 {
     if (! loaded.instances.len ())
-        return;
+        return false;
 
     PluginData & plugin = loaded.plugin;
-    const LADSPA_Descriptor & desc = plugin.desc;
+    const LADSPA_Descriptor & desc = * plugin.desc;
 
     int ports = plugin.in_ports.len ();
     int instances = loaded.instances.len ();
     assert (ports * instances == ladspa_channels);
 
-    while (samples / ladspa_channels > 0)
+    int64_t start = time_ns ();
+
+    for (int i = 0; i < instances; i ++)
+    {
+        LADSPA_Handle handle = loaded.instances[i];
+
+        for (int p = 0; p < ports; p ++)
+        {
+            int channel = ports * i + p;
+            desc.connect_port (handle, plugin.in_ports[p],
+             (LADSPA_Data *) in + channel * LADSPA_BUFLEN);
+            desc.connect_port (handle, plugin.out_ports[p],
+             out + channel * LADSPA_BUFLEN);
+        }
+    }
+
+    RunJob job = {& loaded, frames};
+
+    if (instances > 1)
+        pool.run (run_instances, & job);
+    else
+        run_instances (0, 1, & job);
+
+    loaded.run_time += time_ns () - start;
+    loaded.run_frames += frames;
+
+    return true;
+}
+
+static void run_chain (float * data, int samples)
+{
+    int channels = ladspa_channels;
+
+    while (samples / channels > 0)
     {
-        int frames = aud::min (samples / ladspa_channels, LADSPA_BUFLEN);
+        int frames = aud::min (samples / channels, LADSPA_BUFLEN);
+        int cur = 0;
 
-        for (int i = 0; i < instances; i ++)
+        for (int c = 0; c < channels; c ++)
         {
-            LADSPA_Handle handle = loaded.instances[i];
+            const float * get = data + c;
+            float * in = chain_bufs[0].begin () + c * LADSPA_BUFLEN;
+            float * in_end = in + frames;
 
-            for (int p = 0; p < ports; p ++)
+            while (in < in_end)
             {
-                int channel = ports * i + p;
-                float * get = data + channel;
-                float * in = loaded.in_bufs[channel].begin ();
-                float * in_end = in + frames;
-
-                while (in < in_end)
-                {
-                    * in ++ = * get;
-                    get += ladspa_channels;
-                }
+                * in ++ = * get;
+                get += channels;
             }
+        }
+
+        for (auto & loaded : loadeds)
+        {
+            start_plugin (* loaded);
+
+            if (run_plugin (* loaded, chain_bufs[cur].begin (),
+             chain_bufs[cur ^ 1].begin (), frames))
+                cur ^= 1;
+        }
 
-            desc.run (handle, frames);
+        for (int c = 0; c < channels; c ++)
+        {
+            float * set = data + c;
+            const float * out = chain_bufs[cur].begin () + c * LADSPA_BUFLEN;
+            const float * out_end = out + frames;
 
-            for (int p = 0; p < ports; p ++)
+            while (out < out_end)
             {
-                int channel = ports * i + p;
-                float * set = data + channel;
-                float * out = loaded.out_bufs[channel].begin ();
-                float * out_end = out + frames;
-
-                while (out < out_end)
-                {
-                    * set = * out ++;
-                    set += ladspa_channels;
-                }
+                * set = * out ++;
+                set += channels;
             }
         }
 
-        data += ladspa_channels * frames;
-        samples -= ladspa_channels * frames;
+        data += channels * frames;
+        samples -= channels * frames;
     }
 }
 
@@ -145,7 +207,7 @@ static void flush_plugin (LoadedPlugin & loaded)
         return;
 
     PluginData & plugin = loaded.plugin;
-    const LADSPA_Descriptor & desc = plugin.desc;
+    const LADSPA_Descriptor & desc = * plugin.desc;
 
     int instances = loaded.instances.len ();
     for (int i = 0; i < instances; i ++)
@@ -167,7 +229,7 @@ void shutdown_plugin_locked (LoadedPlugin & loaded)
         return;
 
     PluginData & plugin = loaded.plugin;
-    const LADSPA_Descriptor & desc = plugin.desc;
+    const LADSPA_Descriptor & desc = * plugin.desc;
 
     int instances = loaded.instances.len ();
     for (int i = 0; i < instances; i ++)
@@ -181,8 +243,23 @@ void shutdown_plugin_locked (LoadedPlugin & loaded)
     }
 
     loaded.instances.clear ();
-    loaded.in_bufs.clear ();
-    loaded.out_bufs.clear ();
+}
+
+void update_cpu_loads_locked ()
+{
+    for (auto & loaded : loadeds)
+    {
+        if (! loaded->instances.len ())
+            loaded->cpu_load = -1;
+        else if (loaded->run_frames && ladspa_rate)
+        {
+            double real_ns = (double) loaded->run_frames * 1000000000 / ladspa_rate;
+            loaded->cpu_load = loaded->run_time / real_ns;
+        }
+
+        loaded->run_time = 0;
+        loaded->run_frames = 0;
+    }
 }
 
 void LADSPAHost::start (int & channels, int & rate)
@@ -195,6 +272,12 @@ void LADSPAHost::start (int & channels, int & rate)
     ladspa_channels = channels;
     ladspa_rate = rate;
 
+    for (auto & buf : chain_bufs)
+    {
+        buf.clear ();
+        buf.insert (0, channels * LADSPA_BUFLEN);
+    }
+
     pthread_mutex_unlock (& mutex);
 }
 
@@ -202,11 +285,8 @@ Index<float> & LADSPAHost::process (Index<float> & data)
 {
     pthread_mutex_lock (& mutex);
 
-    for (auto & loaded : loadeds)
-    {
-        start_plugin (* loaded);
-        run_plugin (* loaded, data.begin (), data.len ());
-    }
+    if (loadeds.len ())
+        run_chain (data.begin (), data.len ());
 
     pthread_mutex_unlock (& mutex);
     return data;
@@ -227,12 +307,12 @@ Index<float> & LADSPAHost::finish (Index<float> & data, bool end_of_playlist)
 {
     pthread_mutex_lock (& mutex);
 
-    for (auto & loaded : loadeds)
-    {
-        start_plugin (* loaded);
-        run_plugin (* loaded, data.begin (), data.len ());
+    if (loadeds.len ())
+        run_chain (data.begin (), data.len ());
 
-        if (end_of_playlist)
+    if (end_of_playlist)
+    {
+        for (auto & loaded : loadeds)
             shutdown_plugin_locked (* loaded);
     }
 
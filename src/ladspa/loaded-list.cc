@@ -17,6 +17,8 @@
  * the use of this software.
  */
 
+#include <libaudcore/audstrings.h>
+#include <libaudcore/hook.h>
 #include <libaudgui/list.h>
 
 #include "plugin.h"
@@ -24,9 +26,16 @@
 static void get_value (void * user, int row, int column, GValue * value)
 {
     g_return_if_fail (row >= 0 && row < loadeds.len ());
-    g_return_if_fail (column == 0);
+    g_return_if_fail (column >= 0 && column < 2);
 
-    g_value_set_string (value, loadeds[row]->plugin.desc.Name);
+    LoadedPlugin & loaded = * loadeds[row];
+
+    if (column == 0)
+        g_value_set_string (value, loaded.plugin.name);
+    else if (loaded.cpu_load >= 0)
+        g_value_set_string (value, str_printf ("%.1f%%", loaded.cpu_load * 100));
+    else
+        g_value_set_string (value, "");
 }
 
 static bool get_selected (void * user, int row)
@@ -110,11 +119,33 @@ static const AudguiListCallbacks callbacks = {
     shift_rows
 };
 
+static void update_cpu_column (void * list)
+{
+    pthread_mutex_lock (& mutex);
+    update_cpu_loads_locked ();
+    pthread_mutex_unlock (& mutex);
+
+    int rows = audgui_list_row_count ((GtkWidget *) list);
+    if (rows)
+        audgui_list_update_rows ((GtkWidget *) list, 0, rows);
+}
+
+static void destroy_cb (GtkWidget * list)
+{
+    timer_remove (TimerRate::Hz1, update_cpu_column, list);
+}
+
 GtkWidget * create_loaded_list ()
 {
     GtkWidget * list = audgui_list_new (& callbacks, nullptr, loadeds.len ());
     audgui_list_add_column (list, nullptr, 0, G_TYPE_STRING, -1);
+    audgui_list_add_column (list, nullptr, 1, G_TYPE_STRING, 7);
     gtk_tree_view_set_headers_visible ((GtkTreeView *) list, 0);
+
+    /* show the CPU time used by each plugin as a percentage of real time */
+    timer_add (TimerRate::Hz1, update_cpu_column, list);
+    g_signal_connect (list, "destroy", (GCallback) destroy_cb, nullptr);
+
     return list;
 }
 
@@ -24,10 +24,12 @@
 
 #include <algorithm>
 
+#include <glib/gstdio.h>
 #include <gmodule.h>
 #include <gtk/gtk.h>
 
 #include <libaudcore/audstrings.h>
+#include <libaudcore/multihash.h>
 #include <libaudcore/preferences.h>
 #include <libaudcore/runtime.h>
 #include <libaudgui/libaudgui-gtk.h>
@@ -40,62 +42,93 @@ const char * const LADSPAHost::defaults[] = {
 
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 String module_path;
-Index<GModule *> modules;
+Index<LoadedModule> modules;
 Index<SmartPtr<PluginData>> plugins;
 Index<SmartPtr<LoadedPlugin>> loadeds;
 
 GtkWidget * plugin_list;
 GtkWidget * loaded_list;
 
-static ControlData parse_control (const LADSPA_Descriptor & desc, int port)
+/* The plugin cache records the descriptors of every module found on the
+ * module path, keyed by (path, mtime, size), so that only modules which are
+ * actually used need to be loaded.  The format is line-based:
+ *
+ *    module <mtime> <size> <path>
+ *    plugin <index> <label> <name>
+ *    port <descriptor> <hint> <lower> <upper> <name>
+ *
+ * with strings percent-encoded.  A module line with no plugin lines records a
+ * module that is not a valid LADSPA module. */
+
+#define CACHE_HEADER "ladspa-cache 1"
+
+struct CachedModule
 {
-    const LADSPA_PortRangeHint & hint = desc.PortRangeHints[port];
+    int64_t mtime, size;
+    Index<SmartPtr<PluginData>> plugins;
+};
+
+struct ScannedModule
+{
+    String path;
+    int64_t mtime, size;
+};
+
+static SimpleHash<String, CachedModule> cache;
+static Index<ScannedModule> scanned;
 
+static StringBuf cache_filename ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "ladspa-cache"});
+}
+
+static ControlData parse_control (const PortData & port, int index)
+{
     ControlData control;
-    control.port = port;
-    control.name = String (desc.PortNames[port]);
-    control.is_toggle = LADSPA_IS_HINT_TOGGLED (hint.HintDescriptor) ? 1 : 0;
+    control.port = index;
+    control.name = port.name;
+    control.is_toggle = LADSPA_IS_HINT_TOGGLED (port.hint) ? 1 : 0;
 
-    control.min = LADSPA_IS_HINT_BOUNDED_BELOW (hint.HintDescriptor) ? hint.LowerBound :
-     LADSPA_IS_HINT_BOUNDED_ABOVE (hint.HintDescriptor) ? hint.UpperBound - 100 : -100;
-    control.max = LADSPA_IS_HINT_BOUNDED_ABOVE (hint.HintDescriptor) ? hint.UpperBound :
-     LADSPA_IS_HINT_BOUNDED_BELOW (hint.HintDescriptor) ? hint.LowerBound + 100 : 100;
+    control.min = LADSPA_IS_HINT_BOUNDED_BELOW (port.hint) ? port.lower :
+     LADSPA_IS_HINT_BOUNDED_ABOVE (port.hint) ? port.upper - 100 : -100;
+    control.max = LADSPA_IS_HINT_BOUNDED_ABOVE (port.hint) ? port.upper :
+     LADSPA_IS_HINT_BOUNDED_BELOW (port.hint) ? port.lower + 100 : 100;
 
-    if (LADSPA_IS_HINT_SAMPLE_RATE (hint.HintDescriptor))
+    if (LADSPA_IS_HINT_SAMPLE_RATE (port.hint))
     {
         control.min *= 96000;
         control.max *= 96000;
     }
 
-    if (LADSPA_IS_HINT_DEFAULT_0 (hint.HintDescriptor))
+    if (LADSPA_IS_HINT_DEFAULT_0 (port.hint))
         control.def = 0;
-    else if (LADSPA_IS_HINT_DEFAULT_1 (hint.HintDescriptor))
+    else if (LADSPA_IS_HINT_DEFAULT_1 (port.hint))
         control.def = 1;
-    else if (LADSPA_IS_HINT_DEFAULT_100 (hint.HintDescriptor))
+    else if (LADSPA_IS_HINT_DEFAULT_100 (port.hint))
         control.def = 100;
-    else if (LADSPA_IS_HINT_DEFAULT_440 (hint.HintDescriptor))
+    else if (LADSPA_IS_HINT_DEFAULT_440 (port.hint))
         control.def = 440;
-    else if (LADSPA_IS_HINT_DEFAULT_MINIMUM (hint.HintDescriptor))
+    else if (LADSPA_IS_HINT_DEFAULT_MINIMUM (port.hint))
         control.def = control.min;
-    else if (LADSPA_IS_HINT_DEFAULT_MAXIMUM (hint.HintDescriptor))
+    else if (LADSPA_IS_HINT_DEFAULT_MAXIMUM (port.hint))
         control.def = control.max;
-    else if (LADSPA_IS_HINT_DEFAULT_LOW (hint.HintDescriptor))
+    else if (LADSPA_IS_HINT_DEFAULT_LOW (port.hint))
     {
-        if (LADSPA_IS_HINT_LOGARITHMIC (hint.HintDescriptor))
+        if (LADSPA_IS_HINT_LOGARITHMIC (port.hint))
             control.def = expf (0.75 * logf (control.min) + 0.25 * logf (control.max));
         else
             control.def = 0.75 * control.min + 0.25 * control.max;
     }
-    else if (LADSPA_IS_HINT_DEFAULT_HIGH (hint.HintDescriptor))
+    else if (LADSPA_IS_HINT_DEFAULT_HIGH (port.hint))
     {
-        if (LADSPA_IS_HINT_LOGARITHMIC (hint.HintDescriptor))
+        if (LADSPA_IS_HINT_LOGARITHMIC (port.hint))
             control.def = expf (0.25 * logf (control.min) + 0.75 * logf (control.max));
         else
             control.def = 0.25 * control.min + 0.75 * control.max;
     }
     else
     {
-        if (LADSPA_IS_HINT_LOGARITHMIC (hint.HintDescriptor))
+        if (LADSPA_IS_HINT_LOGARITHMIC (port.hint))
             control.def = expf (0.5 * logf (control.min) + 0.5 * logf (control.max));
         else
             control.def = 0.5 * control.min + 0.5 * control.max;
@@ -104,30 +137,57 @@ static ControlData parse_control (const LADSPA_Descriptor & desc, int port)
     return control;
 }
 
-static void open_plugin (const char * path, const LADSPA_Descriptor & desc)
+/* fills in controls, in_ports, and out_ports from the raw port data */
+static void parse_ports (PluginData & plugin)
 {
-    const char * slash = strrchr (path, G_DIR_SEPARATOR);
-    g_return_if_fail (slash && slash[1]);
-    g_return_if_fail (desc.Label && desc.Name);
+    for (int i = 0; i < plugin.ports.len (); i ++)
+    {
+        const PortData & port = plugin.ports[i];
 
-    PluginData & plugin = * plugins.append (new PluginData (slash + 1, desc));
+        if (LADSPA_IS_PORT_CONTROL (port.descriptor))
+            plugin.controls.append (parse_control (port, i));
+        else if (LADSPA_IS_PORT_AUDIO (port.descriptor) &&
+         LADSPA_IS_PORT_INPUT (port.descriptor))
+            plugin.in_ports.append (i);
+        else if (LADSPA_IS_PORT_AUDIO (port.descriptor) &&
+         LADSPA_IS_PORT_OUTPUT (port.descriptor))
+            plugin.out_ports.append (i);
+    }
+}
+
+static void read_ports (PluginData & plugin, const LADSPA_Descriptor & desc)
+{
+    plugin.ports.clear ();
+    plugin.controls.clear ();
+    plugin.in_ports.clear ();
+    plugin.out_ports.clear ();
 
     for (unsigned i = 0; i < desc.PortCount; i ++)
     {
-        if (LADSPA_IS_PORT_CONTROL (desc.PortDescriptors[i]))
-            plugin.controls.append (parse_control (desc, i));
-        else if (LADSPA_IS_PORT_AUDIO (desc.PortDescriptors[i]) &&
-         LADSPA_IS_PORT_INPUT (desc.PortDescriptors[i]))
-            plugin.in_ports.append (i);
-        else if (LADSPA_IS_PORT_AUDIO (desc.PortDescriptors[i]) &&
-         LADSPA_IS_PORT_OUTPUT (desc.PortDescriptors[i]))
-            plugin.out_ports.append (i);
+        const LADSPA_PortRangeHint & hint = desc.PortRangeHints[i];
+        plugin.ports.append (PortData {desc.PortDescriptors[i],
+         hint.HintDescriptor, hint.LowerBound, hint.UpperBound,
+         String (desc.PortNames[i])});
     }
+
+    parse_ports (plugin);
+}
+
+static void open_plugin (const char * path, int index, const LADSPA_Descriptor & desc)
+{
+    const char * slash = strrchr (path, G_DIR_SEPARATOR);
+    g_return_if_fail (slash && slash[1]);
+    g_return_if_fail (desc.Label && desc.Name);
+
+    PluginData & plugin = * plugins.append (new PluginData (slash + 1, path,
+     index, desc.Label, desc.Name));
+
+    read_ports (plugin, desc);
 }
 
-static GModule * open_module (const char * path)
+static LADSPA_Descriptor_Function open_module (const char * path, GModule * & handle)
 {
-    GModule * handle = g_module_open (path, G_MODULE_BIND_LOCAL);
+    handle = g_module_open (path, G_MODULE_BIND_LOCAL);
     if (! handle)
     {
         AUDERR ("Failed to open module %s: %s\n", path, g_module_error ());
@@ -139,16 +199,26 @@ static GModule * open_module (const char * path)
     {
         AUDERR ("Not a valid LADSPA module: %s\n", path);
         g_module_close (handle);
+        handle = nullptr;
         return nullptr;
     }
 
-    LADSPA_Descriptor_Function descfun = (LADSPA_Descriptor_Function) sym;
+    return (LADSPA_Descriptor_Function) sym;
+}
+
+/* loads a module only to read its descriptors; the module is closed again */
+static void scan_module (const char * path)
+{
+    GModule * handle;
+    LADSPA_Descriptor_Function descfun = open_module (path, handle);
+    if (! descfun)
+        return;
 
     const LADSPA_Descriptor * desc;
     for (int i = 0; (desc = descfun (i)); i ++)
-        open_plugin (path, * desc);
+        open_plugin (path, i, * desc);
 
-    return handle;
+    g_module_close (handle);
 }
 
 static void open_modules_for_path (const char * path)
@@ -166,10 +236,26 @@ static void open_modules_for_path (const char * path)
         if (! str_has_suffix_nocase (name, G_MODULE_SUFFIX))
             continue;
 
-        GModule * handle = open_module (filename_build ({path, name}));
+        StringBuf filename = filename_build ({path, name});
 
-        if (handle)
-            modules.append (handle);
+        GStatBuf st;
+        if (g_stat (filename, & st) < 0)
+            continue;
+
+        String key (filename);
+        CachedModule * cached = cache.lookup (key);
+
+        if (cached && cached->mtime == (int64_t) st.st_mtime &&
+         cached->size == (int64_t) st.st_size)
+        {
+            for (auto & plugin : cached->plugins)
+                plugins.append (std::move (plugin));
+        }
+        else
+            scan_module (filename);
+
+        cache.remove (key);
+        scanned.append (ScannedModule {key, (int64_t) st.st_mtime, (int64_t) st.st_size});
     }
 
     g_dir_close (folder);
@@ -188,28 +274,218 @@ static void open_modules_for_paths (const char * paths)
     g_strfreev (split);
 }
 
+static void read_cache ()
+{
+    char * text = nullptr;
+    if (! g_file_get_contents (cache_filename (), & text, nullptr, nullptr))
+        return;
+
+    char * * lines = g_strsplit (text, "\n", -1);
+    g_free (text);
+
+    if (! lines[0] || strcmp (lines[0], CACHE_HEADER))
+    {
+        g_strfreev (lines);
+        return;
+    }
+
+    CachedModule * module = nullptr;
+    PluginData * plugin = nullptr;
+    String module_file;
+
+    for (int i = 1; lines[i]; i ++)
+    {
+        char * * fields = g_strsplit (lines[i], " ", -1);
+        int n_fields = g_strv_length (fields);
+
+        if (n_fields == 4 && ! strcmp (fields[0], "module"))
+        {
+            if (plugin)
+                parse_ports (* plugin);
+
+            module_file = String (str_decode_percent (fields[3]));
+            module = cache.add (module_file, CachedModule ());
+            module->mtime = g_ascii_strtoll (fields[1], nullptr, 10);
+            module->size = g_ascii_strtoll (fields[2], nullptr, 10);
+            plugin = nullptr;
+        }
+        else if (n_fields == 4 && ! strcmp (fields[0], "plugin") && module)
+        {
+            if (plugin)
+                parse_ports (* plugin);
+
+            const char * slash = strrchr (module_file, G_DIR_SEPARATOR);
+
+            if (slash && slash[1])
+                plugin = module->plugins.append (new PluginData (slash + 1,
+                 module_file, atoi (fields[1]), str_decode_percent (fields[2]),
+                 str_decode_percent (fields[3]))).get ();
+            else
+                plugin = nullptr;
+        }
+        else if (n_fields == 6 && ! strcmp (fields[0], "port") && plugin)
+        {
+            plugin->ports.append (PortData {atoi (fields[1]), atoi (fields[2]),
+             (float) g_ascii_strtod (fields[3], nullptr),
+             (float) g_ascii_strtod (fields[4], nullptr),
+             String (str_decode_percent (fields[5]))});
+        }
+
+        g_strfreev (fields);
+    }
+
+    if (plugin)
+        parse_ports (* plugin);
+
+    g_strfreev (lines);
+}
+
+static void write_cache ()
+{
+    GString * text = g_string_new (CACHE_HEADER "\n");
+    char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+    int p = 0;
+    for (auto & module : scanned)
+    {
+        g_string_append_printf (text, "module %" G_GINT64_FORMAT " %"
+         G_GINT64_FORMAT " %s\n", module.mtime, module.size,
+         (const char *) str_encode_percent (module.path));
+
+        for (; p < plugins.len () && ! strcmp (plugins[p]->module, module.path); p ++)
+        {
+            PluginData & plugin = * plugins[p];
+
+            g_string_append_printf (text, "plugin %d %s %s\n", plugin.index,
+             (const char *) str_encode_percent (plugin.label),
+             (const char *) str_encode_percent (plugin.name));
+
+            for (auto & port : plugin.ports)
+            {
+                g_string_append_printf (text, "port %d %d", port.descriptor, port.hint);
+                g_string_append_printf (text, " %s", g_ascii_dtostr (buf, sizeof buf, port.lower));
+                g_string_append_printf (text, " %s", g_ascii_dtostr (buf, sizeof buf, port.upper));
+                g_string_append_printf (text, " %s\n", (const char *) str_encode_percent (port.name));
+            }
+        }
+    }
+
+    if (! g_file_set_contents (cache_filename (), text->str, text->len, nullptr))
+        AUDERR ("Failed to write %s\n", (const char *) cache_filename ());
+
+    g_string_free (text, true);
+}
+
 static void open_modules ()
 {
+    int64_t start = g_get_monotonic_time ();
+
+    read_cache ();
+
     open_modules_for_paths (getenv ("LADSPA_PATH"));
     open_modules_for_paths (module_path);
+
+    write_cache ();
+
+    cache.clear ();
+    scanned.clear ();
+
+    AUDINFO ("Found %d LADSPA plugins in %d ms.\n", plugins.len (),
+     (int) ((g_get_monotonic_time () - start) / 1000));
 }
 
 static void close_modules ()
 {
     plugins.clear ();
 
-    for (GModule * module : modules)
-        g_module_close (module);
+    for (auto & module : modules)
+        g_module_close (module.handle);
+
+    modules.clear ();
+}
+
+/* The module has changed since the cache was written (without its size or
+ * modification time changing, or while we were running).  The plugin is
+ * looked up again by its label and its ports are read from the module; the
+ * cache file is removed so that all modules are scanned at the next start. */
+static const LADSPA_Descriptor * reload_plugin (PluginData & plugin,
+ LADSPA_Descriptor_Function descfun)
+{
+    AUDWARN ("Plugin %s has changed in %s; reloading.\n",
+     (const char *) plugin.label, (const char *) plugin.module);
+
+    g_unlink (cache_filename ());
+
+    const LADSPA_Descriptor * desc;
+    for (int i = 0; (desc = descfun (i)); i ++)
+    {
+        if (desc->Label && desc->Name && ! strcmp (desc->Label, plugin.label))
+        {
+            plugin.index = i;
+            plugin.name = String (desc->Name);
+            read_ports (plugin, * desc);
+            return desc;
+        }
+    }
+
+    AUDERR ("Plugin %s is no longer in %s.\n", (const char *) plugin.label,
+     (const char *) plugin.module);
+
+    return nullptr;
 }
 
-LoadedPlugin & enable_plugin_locked (PluginData & plugin)
+/* loads the module containing a plugin, if it is not loaded already */
+static bool load_plugin_desc (PluginData & plugin)
 {
+    if (plugin.desc)
+        return true;
+
+    GModule * handle = nullptr;
+
+    for (auto & module : modules)
+    {
+        if (! strcmp (module.path, plugin.module))
+            handle = module.handle;
+    }
+
+    if (! handle)
+    {
+        LADSPA_Descriptor_Function descfun = open_module (plugin.module, handle);
+        if (! descfun)
+            return false;
+
+        modules.append (LoadedModule {plugin.module, handle});
+    }
+
+    void * sym;
+    if (! g_module_symbol (handle, "ladspa_descriptor", & sym))
+        return false;
+
+    auto descfun = (LADSPA_Descriptor_Function) sym;
+    const LADSPA_Descriptor * desc = descfun (plugin.index);
+
+    if (! desc || ! desc->Label || strcmp (desc->Label, plugin.label) ||
+     desc->PortCount != (unsigned) plugin.ports.len ())
+    {
+        if (! (desc = reload_plugin (plugin, descfun)))
+            return false;
+    }
+
+    plugin.desc = desc;
+    return true;
+}
+
+LoadedPlugin * enable_plugin_locked (PluginData & plugin)
+{
+    if (! load_plugin_desc (plugin))
+        return nullptr;
+
     LoadedPlugin & loaded = * loadeds.append (new LoadedPlugin (plugin));
 
     for (auto & control : plugin.controls)
         loaded.values.append (control.def);
 
-    return loaded;
+    return & loaded;
 }
 
 void disable_plugin_locked (LoadedPlugin & loaded)
@@ -224,7 +500,7 @@ static PluginData * find_plugin (const char * path, const char * label)
 {
     for (auto & plugin : plugins)
     {
-        if (! strcmp (plugin->path, path) && ! strcmp (plugin->desc.Label, label))
+        if (! strcmp (plugin->path, path) && ! strcmp (plugin->label, label))
             return plugin.get ();
     }
 
@@ -242,7 +518,7 @@ static void save_enabled_to_config ()
         LoadedPlugin & loaded = * loadeds[i];
 
         aud_set_str ("ladspa", str_printf ("plugin%d_path", i), loaded.plugin.path);
-        aud_set_str ("ladspa", str_printf ("plugin%d_label", i), loaded.plugin.desc.Label);
+        aud_set_str ("ladspa", str_printf ("plugin%d_label", i), loaded.plugin.label);
 
         Index<double> temp;
         temp.insert (0, loaded.values.len ());
@@ -277,7 +553,11 @@ static void load_enabled_from_config ()
         if (! plugin)
             continue;
 
-        LoadedPlugin & loaded = enable_plugin_locked (* plugin);
+        LoadedPlugin * loaded_ptr = enable_plugin_locked (* plugin);
+        if (! loaded_ptr)
+            continue;
+
+        LoadedPlugin & loaded = * loaded_ptr;
 
         String controls = aud_get_str ("ladspa", str_printf ("plugin%d_controls", i));
 
@@ -321,8 +601,8 @@ void LADSPAHost::cleanup ()
     aud_set_str ("ladspa", "module_path", module_path);
     save_enabled_to_config ();
     close_modules ();
+    stop_workers ();
 
-    modules.clear ();
     plugins.clear ();
     loadeds.clear ();
 
@@ -412,7 +692,7 @@ static void configure_plugin (LoadedPlugin & loaded)
 
     PluginData & plugin = loaded.plugin;
 
-    StringBuf title = str_printf (_("%s Settings"), plugin.desc.Name);
+    StringBuf title = str_printf (_("%s Settings"), (const char *) plugin.name);
     loaded.settings_win = gtk_dialog_new_with_buttons (title, nullptr,
      (GtkDialogFlags) 0, _("_Close"), GTK_RESPONSE_CLOSE, nullptr);
     gtk_window_set_resizable ((GtkWindow *) loaded.settings_win, 0);
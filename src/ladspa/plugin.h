@@ -21,6 +21,8 @@
 #define AUD_LADSPA_PLUGIN_H
 
 #include <pthread.h>
+#include <stdint.h>
+#include <gmodule.h>
 #include <gtk/gtk.h>
 
 #include <libaudcore/i18n.h>
@@ -39,17 +41,34 @@ struct ControlData {
     float min, max, def;
 };
 
+/* raw port information, as stored in the plugin cache */
+struct PortData {
+    int descriptor, hint;
+    float lower, upper;
+    String name;
+};
+
 struct PluginData
 {
-    String path;
-    const LADSPA_Descriptor & desc;
+    String path;    /* file name of the module, used in the config */
+    String module;  /* full path of the module */
+    int index;      /* index passed to ladspa_descriptor() */
+    String label, name;
+    Index<PortData> ports;
     Index<ControlData> controls;
     Index<int> in_ports, out_ports;
     bool selected = false;
 
-    PluginData (const char * path, const LADSPA_Descriptor & desc) :
+    /* only set once the module has been loaded (see enable_plugin_locked) */
+    const LADSPA_Descriptor * desc = nullptr;
+
+    PluginData (const char * path, const char * module, int index,
+     const char * label, const char * name) :
         path (path),
-        desc (desc) {}
+        module (module),
+        index (index),
+        label (label),
+        name (name) {}
 };
 
 struct LoadedPlugin
@@ -59,13 +78,23 @@ struct LoadedPlugin
     bool selected = false;
     bool active = false;
     Index<LADSPA_Handle> instances;
-    Index<Index<float>> in_bufs, out_bufs;
     GtkWidget * settings_win = nullptr;
 
+    /* time spent in run() since the last UI update, and the resulting
+     * fraction of real time (updated by update_cpu_loads) */
+    int64_t run_time = 0, run_frames = 0;
+    float cpu_load = -1;
+
     LoadedPlugin (PluginData & plugin) :
         plugin (plugin) {}
 };
 
+struct LoadedModule
+{
+    String path;
+    GModule * handle;
+};
+
 class LADSPAHost : public EffectPlugin
 {
 public:
@@ -100,19 +129,21 @@ public:
 
 extern pthread_mutex_t mutex;
 extern String module_path;
-extern Index<GModule *> modules;
+extern Index<LoadedModule> modules;
 extern Index<SmartPtr<PluginData>> plugins;
 extern Index<SmartPtr<LoadedPlugin>> loadeds;
 
 extern GtkWidget * plugin_list;
 extern GtkWidget * loaded_list;
 
-LoadedPlugin & enable_plugin_locked (PluginData & plugin);
+LoadedPlugin * enable_plugin_locked (PluginData & plugin);
 void disable_plugin_locked (LoadedPlugin & loaded);
 
 /* effect.c */
 
 void shutdown_plugin_locked (LoadedPlugin & loaded);
+void stop_workers ();
+void update_cpu_loads_locked ();
 
 /* plugin-list.c */
 
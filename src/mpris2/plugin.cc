@@ -19,6 +19,7 @@
 
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
 
 #include <libaudcore/drct.h>
 #include <libaudcore/hook.h>
@@ -50,8 +51,69 @@ EXPORT MPRIS2Plugin aud_plugin_instance;
 static GObject * object_core, * object_player;
 static String last_title, last_artist, last_album, last_file;
 static int last_length;
+static int last_volume = -1;
 static AudArtPtr image;
 
+/* The position is read from the player when a client asks for it rather
+ * than stored in the object several times a second; clients are expected
+ * to extrapolate it during playback and to follow the Seeked signal.  The
+ * D-Bus property is answered by the skeleton from its own copy, so the
+ * request is caught in the interface vtable before it gets there.  The
+ * volume is answered the same way, so that it is current even between two
+ * checks by update_volume(). */
+struct AudMprisPlayer {
+    MprisMediaPlayer2PlayerSkeleton parent;
+};
+
+struct AudMprisPlayerClass {
+    MprisMediaPlayer2PlayerSkeletonClass parent_class;
+};
+
+G_DEFINE_TYPE (AudMprisPlayer, aud_mpris_player, MPRIS_TYPE_MEDIA_PLAYER2_PLAYER_SKELETON)
+
+static GDBusInterfaceVTable player_vtable;
+static GDBusInterfaceGetPropertyFunc skeleton_get_property;
+
+static int64_t get_position ()
+{
+    if (aud_drct_get_playing () && aud_drct_get_ready ())
+        return (int64_t) aud_drct_get_time () * 1000;
+
+    return 0;
+}
+
+static GVariant * player_get_property (GDBusConnection * connection,
+ const char * sender, const char * object_path, const char * interface_name,
+ const char * property_name, GError * * error, void * user_data)
+{
+    if (! strcmp (property_name, "Position"))
+        return g_variant_new_int64 (get_position ());
+    if (! strcmp (property_name, "Volume"))
+        return g_variant_new_double ((double) aud_drct_get_volume_main () / 100);
+
+    return skeleton_get_property (connection, sender, object_path,
+     interface_name, property_name, error, user_data);
+}
+
+static GDBusInterfaceVTable * aud_mpris_player_get_vtable (GDBusInterfaceSkeleton * skeleton)
+{
+    GDBusInterfaceVTable * vtable = G_DBUS_INTERFACE_SKELETON_CLASS
+     (aud_mpris_player_parent_class)->get_vtable (skeleton);
+
+    player_vtable = * vtable;
+    skeleton_get_property = vtable->get_property;
+    player_vtable.get_property = player_get_property;
+
+    return & player_vtable;
+}
+
+static void aud_mpris_player_class_init (AudMprisPlayerClass * klass)
+{
+    G_DBUS_INTERFACE_SKELETON_CLASS (klass)->get_vtable = aud_mpris_player_get_vtable;
+}
+
+static void aud_mpris_player_init (AudMprisPlayer * player) {}
+
 static gboolean quit_cb (MprisMediaPlayer2 * object, GDBusMethodInvocation * call,
  void * unused)
 {
@@ -167,18 +229,20 @@ static void volume_changed (GObject * object)
     aud_drct_set_volume_main (round (vol * 100));
 }
 
-static void update (void * object)
+/* there is no hook for volume changes, so the volume is checked
+ * periodically; the object (and so PropertiesChanged) is only updated when
+ * it has actually changed */
+static void update_volume (void * object)
 {
-    int64_t pos = 0;
-    int vol = 0;
+    int vol = aud_drct_get_volume_main ();
 
-    if (aud_drct_get_playing () && aud_drct_get_ready ())
-        pos = (int64_t) aud_drct_get_time () * 1000;
+    if (vol == last_volume)
+        return;
 
-    vol = aud_drct_get_volume_main ();
+    last_volume = vol;
 
     g_signal_handlers_block_by_func (object, (void *) volume_changed, nullptr);
-    g_object_set ((GObject *) object, "position", pos, "volume", (double) vol / 100, nullptr);
+    g_object_set ((GObject *) object, "volume", (double) vol / 100, nullptr);
     g_signal_handlers_unblock_by_func (object, (void *) volume_changed, nullptr);
 }
 
@@ -192,7 +256,6 @@ static void update_playback_status (void * data, GObject * object)
         status = "Stopped";
 
     g_object_set (object, "playback-status", status, nullptr);
-    update (object);
 }
 
 static void emit_seek (void * data, GObject * object)
@@ -284,7 +347,7 @@ void MPRIS2Plugin::cleanup ()
     hook_dissociate ("playback ready", (HookFunction) emit_seek);
     hook_dissociate ("playback seek", (HookFunction) emit_seek);
 
-    timer_remove (TimerRate::Hz4, update, object_player);
+    timer_remove (TimerRate::Hz4, update_volume, object_player);
 
     g_object_unref (object_core);
     g_object_unref (object_player);
@@ -294,6 +357,7 @@ void MPRIS2Plugin::cleanup ()
     last_album = String ();
     last_file = String ();
     last_length = 0;
+    last_volume = -1;
 
     image.clear ();
 }
@@ -329,7 +393,7 @@ bool MPRIS2Plugin::init ()
     g_signal_connect (object_core, "handle-quit", (GCallback) quit_cb, nullptr);
     g_signal_connect (object_core, "handle-raise", (GCallback) raise_cb, nullptr);
 
-    object_player = (GObject *) mpris_media_player2_player_skeleton_new ();
+    object_player = (GObject *) g_object_new (aud_mpris_player_get_type (), nullptr);
 
     g_object_set (object_player,
      "can-control", (gboolean) true,
@@ -341,6 +405,7 @@ bool MPRIS2Plugin::init ()
      nullptr);
 
     update_playback_status (nullptr, object_player);
+    update_volume (object_player);
 
     if (aud_drct_get_playing () && aud_drct_get_ready ())
         emit_seek (nullptr, object_player);
@@ -357,7 +422,7 @@ bool MPRIS2Plugin::init ()
     hook_associate ("playback ready", (HookFunction) emit_seek, object_player);
     hook_associate ("playback seek", (HookFunction) emit_seek, object_player);
 
-    timer_add (TimerRate::Hz4, update, object_player);
+    timer_add (TimerRate::Hz4, update_volume, object_player);
 
     g_signal_connect (object_player, "handle-next", (GCallback) next_cb, nullptr);
     g_signal_connect (object_player, "handle-pause", (GCallback) pause_cb, nullptr);
@@ -7,7 +7,25 @@
 typedef void genf(void);
 typedef int offs_t;
 
-#define cpu_readop32(pc) program_read_dword_32le(pc)
+// Main RAM is mapped through a table of 1 MB pages so that instruction
+// fetches and RAM loads/stores skip the I/O range checks in psx_hw_read and
+// psx_hw_write.  A null entry means the page has to go through those.
+#define MEM_PAGE_SHIFT	(20)
+#define MEM_PAGE_MASK	((1 << MEM_PAGE_SHIFT) - 1)
+
+extern uint32_t *psx_mem_pages[1 << (32 - MEM_PAGE_SHIFT)];
+extern uint32_t program_read_dword_32le(offs_t address);
+
+static inline uint32_t cpu_readop32(offs_t pc)
+{
+	uint32_t *page = psx_mem_pages[(uint32_t)pc >> MEM_PAGE_SHIFT];
+
+	if (page)
+		return FROM_LE32(page[(pc & MEM_PAGE_MASK) >> 2]);
+
+	return program_read_dword_32le(pc);
+}
+
 #define change_pc(pc)																	\
 
 
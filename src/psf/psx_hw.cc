@@ -242,6 +242,30 @@ uint32_t psx_scratch[0x400];
 uint32_t initial_ram[(2*1024*1024)/4];
 uint32_t initial_scratch[0x400];
 
+uint32_t *psx_mem_pages[1 << (32 - MEM_PAGE_SHIFT)];
+
+// map the same ranges psx_hw_read/psx_hw_write treat as RAM: 0x00000000-0x007fffff
+// and 0x80000000-0x807fffff, both mirroring the 2 MB every 2 MB
+static void psx_map_ram(void)
+{
+	memset(psx_mem_pages, 0, sizeof(psx_mem_pages));
+
+	for (uint32_t base = 0; base < 0x00800000; base += 1 << MEM_PAGE_SHIFT)
+	{
+		uint32_t *page = &psx_ram[(base & 0x1fffff)>>2];
+
+		psx_mem_pages[base >> MEM_PAGE_SHIFT] = page;
+		psx_mem_pages[(0x80000000 | base) >> MEM_PAGE_SHIFT] = page;
+	}
+}
+
+static inline uint32_t *psx_ram_word(offs_t address)
+{
+	uint32_t *page = psx_mem_pages[(uint32_t)address >> MEM_PAGE_SHIFT];
+
+	return page ? &page[(address & MEM_PAGE_MASK) >> 2] : nullptr;
+}
+
 static uint32_t spu_delay, dma_icr, irq_data, irq_mask, dma_timer, WAI;
 static uint32_t dma4_madr, dma4_bcr, dma4_chcr, dma4_delay;
 static uint32_t dma7_madr, dma7_bcr, dma7_chcr, dma7_delay;
@@ -1279,6 +1303,8 @@ static uint32_t calc_spec(uint32_t a1)
 
 void psx_hw_init(void)
 {
+	psx_map_ram();
+
 	timerexp = 0;
 
 	memset(filestat, 0, sizeof(filestat));
@@ -1983,8 +2009,16 @@ void SPUirq(void)
 
 // PSXCPU callbacks
 
+// RAM accesses are resolved through psx_mem_pages; everything else goes
+// through psx_hw_read/psx_hw_write with the lane masks below
+
 uint8_t program_read_byte_32le(offs_t address)
 {
+	uint32_t *word = psx_ram_word(address);
+
+	if (word)
+		return LE32(*word) >> ((address & 3) * 8);
+
 	switch (address & 0x3)
 	{
 		case 0:
@@ -2006,6 +2040,11 @@ uint8_t program_read_byte_32le(offs_t address)
 
 uint16_t program_read_word_32le(offs_t address)
 {
+	uint32_t *word = psx_ram_word(address);
+
+	if (word)
+		return LE32(*word) >> ((address & 2) * 8);
+
 	if (address & 2)
 		return psx_hw_read(address, 0x0000ffff)>>16;
 
@@ -2014,11 +2053,25 @@ uint16_t program_read_word_32le(offs_t address)
 
 uint32_t program_read_dword_32le(offs_t address)
 {
+	uint32_t *word = psx_ram_word(address);
+
+	if (word)
+		return LE32(*word);
+
 	return psx_hw_read(address, 0);
 }
 
 void program_write_byte_32le(offs_t address, uint8_t data)
 {
+	uint32_t *word = psx_ram_word(address);
+
+	if (word)
+	{
+		int shift = (address & 3) * 8;
+		*word = (*word & LE32(~(0xffu << shift))) | LE32((uint32_t)data << shift);
+		return;
+	}
+
 	switch (address & 0x3)
 	{
 		case 0:
@@ -2038,6 +2091,15 @@ void program_write_byte_32le(offs_t address, uint8_t data)
 
 void program_write_word_32le(offs_t address, uint16_t data)
 {
+	uint32_t *word = psx_ram_word(address);
+
+	if (word)
+	{
+		int shift = (address & 2) * 8;
+		*word = (*word & LE32(~(0xffffu << shift))) | LE32((uint32_t)data << shift);
+		return;
+	}
+
 	if (address & 2)
 	{
 		psx_hw_write(address, data<<16, 0x0000ffff);
@@ -2049,6 +2111,14 @@ void program_write_word_32le(offs_t address, uint16_t data)
 
 void program_write_dword_32le(offs_t address, uint32_t data)
 {
+	uint32_t *word = psx_ram_word(address);
+
+	if (word)
+	{
+		*word = LE32(data);
+		return;
+	}
+
 	psx_hw_write(address, data, 0);
 }
 
@@ -23,10 +23,13 @@
 #include <condition_variable>
 #include <mutex>
 
+#include <string.h>
+
 #include <pulse/pulseaudio.h>
 
 #include <libaudcore/runtime.h>
 #include <libaudcore/plugin.h>
+#include <libaudcore/preferences.h>
 #include <libaudcore/i18n.h>
 
 using scoped_lock = std::unique_lock<std::mutex>;
@@ -35,11 +38,15 @@ class PulseOutput : public OutputPlugin
 {
 public:
     static const char about[];
+    static const char * const defaults[];
+    static const PreferencesWidget widgets[];
+    static const PluginPreferences prefs;
 
     static constexpr PluginInfo info = {
         N_("PulseAudio Output"),
         PACKAGE,
-        about
+        about,
+        & prefs
     };
 
     constexpr PulseOutput () : OutputPlugin (info, 8) {}
@@ -65,6 +72,39 @@ public:
 
 EXPORT PulseOutput aud_plugin_instance;
 
+/* Latency profiles: the default follows the global output buffer size; low
+ * latency keeps only a few fragments queued for interactive use; battery
+ * saving queues several seconds and lets the server request data in large
+ * chunks, so that the player wakes up rarely. */
+enum {
+    PROFILE_DEFAULT,
+    PROFILE_LOW_LATENCY,
+    PROFILE_BATTERY
+};
+
+#define LOW_LATENCY_MS 40
+#define BATTERY_MS 4000
+
+const char * const PulseOutput::defaults[] = {
+    "latency_profile", aud::numeric_string<PROFILE_DEFAULT>::str,
+    nullptr
+};
+
+static const ComboItem profile_items[] = {
+    ComboItem (N_("Default"), PROFILE_DEFAULT),
+    ComboItem (N_("Low latency"), PROFILE_LOW_LATENCY),
+    ComboItem (N_("Battery saving"), PROFILE_BATTERY)
+};
+
+const PreferencesWidget PulseOutput::widgets[] = {
+    WidgetCombo (N_("Latency profile:"),
+        WidgetInt ("pulse", "latency_profile"),
+        {{profile_items}}),
+    WidgetLabel (N_("<small>Takes effect when the next song starts.</small>"))
+};
+
+const PluginPreferences PulseOutput::prefs = {{widgets}};
+
 static std::mutex pulse_mutex;
 static std::condition_variable pulse_cond;
 
@@ -73,6 +113,11 @@ static pa_stream * stream = nullptr;
 static pa_mainloop * mainloop = nullptr;
 
 static bool connected, flushed, polling;
+static int profile;
+
+/* playback statistics, reported when the stream is closed */
+static int underruns;
+static int64_t latency_sum, latency_max, latency_count;
 
 static pa_cvolume volume;
 
@@ -282,6 +327,19 @@ void PulseOutput::flush ()
         pa_mainloop_wakeup (mainloop);
 }
 
+static void record_latency ()
+{
+    pa_usec_t usec;
+    int neg;
+
+    if (pa_stream_get_latency (stream, & usec, & neg) == PA_OK && ! neg)
+    {
+        latency_sum += usec;
+        latency_max = aud::max (latency_max, (int64_t) usec);
+        latency_count ++;
+    }
+}
+
 void PulseOutput::period_wait ()
 {
     scoped_lock lock (pulse_mutex);
@@ -292,8 +350,20 @@ void PulseOutput::period_wait ()
     /* if the connection dies, wait until flush() is called */
     while ((! pa_stream_writable_size (stream) || ! alive ()) && ! flushed)
         poll_events (lock);
+
+    /* without automatic timing updates, refresh them once per request */
+    if (profile == PROFILE_BATTERY)
+    {
+        pa_operation * op = pa_stream_update_timing_info (stream, nullptr, nullptr);
+        if (op)
+            pa_operation_unref (op);
+    }
+
+    record_latency ();
 }
 
+/* Data is copied straight into a buffer allocated by the server (shared memory
+ * if available) rather than handed to pa_stream_write() to be copied again. */
 int PulseOutput::write_audio (const void * ptr, int length)
 {
     scoped_lock lock (pulse_mutex);
@@ -301,10 +371,35 @@ int PulseOutput::write_audio (const void * ptr, int length)
 
     length = aud::min ((size_t) length, pa_stream_writable_size (stream));
 
-    if (pa_stream_write (stream, ptr, length, nullptr, 0, PA_SEEK_RELATIVE) < 0)
-        REPORT ("pa_stream_write");
-    else
-        ret = length;
+    while (ret < length)
+    {
+        void * data;
+        size_t size = length - ret;
+
+        if (pa_stream_begin_write (stream, & data, & size) < 0 || ! data)
+        {
+            /* fall back to a copying write */
+            if (pa_stream_write (stream, (const char *) ptr + ret, length - ret,
+             nullptr, 0, PA_SEEK_RELATIVE) < 0)
+                REPORT ("pa_stream_write");
+            else
+                ret = length;
+
+            break;
+        }
+
+        size = aud::min (size, (size_t) (length - ret));
+        memcpy (data, (const char *) ptr + ret, size);
+
+        if (pa_stream_write (stream, data, size, nullptr, 0, PA_SEEK_RELATIVE) < 0)
+        {
+            REPORT ("pa_stream_write");
+            pa_stream_cancel_write (stream);
+            break;
+        }
+
+        ret += size;
+    }
 
     flushed = false;
     return ret;
@@ -316,6 +411,11 @@ static void close_audio_locked (scoped_lock & lock)
     while (polling)
         pulse_cond.wait (lock);
 
+    if (connected && latency_count)
+        AUDINFO ("Server latency: %d ms average, %d ms maximum; %d underruns.\n",
+         (int) (latency_sum / latency_count / 1000), (int) (latency_max / 1000),
+         underruns);
+
     connected = false;
 
     if (stream)
@@ -380,13 +480,31 @@ static bool set_sample_spec (pa_sample_spec & ss, int fmt, int rate, int nch)
 static void set_buffer_attr (pa_buffer_attr & buffer, const pa_sample_spec & ss)
 {
     int buffer_ms = aud_get_int (nullptr, "output_buffer_size");
+
+    if (profile == PROFILE_LOW_LATENCY)
+        buffer_ms = LOW_LATENCY_MS;
+    else if (profile == PROFILE_BATTERY)
+        buffer_ms = aud::max (buffer_ms, BATTERY_MS);
+
     size_t buffer_size = pa_usec_to_bytes ((pa_usec_t) 1000 * buffer_ms, & ss);
 
     buffer.maxlength = (uint32_t) -1;
     buffer.tlength = buffer_size;
     buffer.prebuf = (uint32_t) -1;
-    buffer.minreq = (uint32_t) -1;
     buffer.fragsize = buffer_size;
+
+    if (profile == PROFILE_LOW_LATENCY)
+        buffer.minreq = buffer_size / 4;
+    else if (profile == PROFILE_BATTERY)
+        buffer.minreq = buffer_size / 2;  /* refill only when half empty */
+    else
+        buffer.minreq = (uint32_t) -1;
+}
+
+static void underflow_cb (pa_stream *, void *)
+{
+    underruns ++;
+    AUDDBG ("Buffer underrun (%d so far).\n", underruns);
 }
 
 static bool create_context (scoped_lock & lock)
@@ -437,8 +555,18 @@ static bool create_stream (scoped_lock & lock, const pa_sample_spec & ss)
     pa_buffer_attr buffer;
     set_buffer_attr (buffer, ss);
 
-    auto flags = pa_stream_flags_t (PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE);
-    if (pa_stream_connect_playback (stream, nullptr, & buffer, flags, nullptr, nullptr) < 0)
+    pa_stream_set_underflow_callback (stream, underflow_cb, nullptr);
+
+    /* automatic timing updates wake the main loop every 100 ms; in battery
+     * mode they are requested from period_wait() instead */
+    int flags = PA_STREAM_INTERPOLATE_TIMING;
+    if (profile != PROFILE_BATTERY)
+        flags |= PA_STREAM_AUTO_TIMING_UPDATE;
+    if (profile == PROFILE_LOW_LATENCY)
+        flags |= PA_STREAM_ADJUST_LATENCY;
+
+    if (pa_stream_connect_playback (stream, nullptr, & buffer,
+     (pa_stream_flags_t) flags, nullptr, nullptr) < 0)
     {
         REPORT ("pa_stream_connect_playback");
         return false;
@@ -487,6 +615,10 @@ bool PulseOutput::open_audio (int fmt, int rate, int nch, String & error)
     if (! set_sample_spec (ss, fmt, rate, nch))
         return false;
 
+    profile = aud_get_int ("pulse", "latency_profile");
+    underruns = 0;
+    latency_sum = latency_max = latency_count = 0;
+
     if (! create_context (lock) ||
         ! create_stream (lock, ss) ||
         ! subscribe_events (lock))
@@ -508,6 +640,8 @@ bool PulseOutput::open_audio (int fmt, int rate, int nch, String & error)
 
 bool PulseOutput::init ()
 {
+    aud_config_set_defaults ("pulse", defaults);
+
     /* check for a running server and get initial volume */
     String error;
     if (! open_audio (FMT_S16_NE, 44100, 2, error))
@@ -0,0 +1 @@
+#include "../ui-common/band-map.cc"
@@ -0,0 +1,2 @@
+#include "../ui-common/art-thumb.cc"
+#include "../ui-common/art-thumb-qt.cc"
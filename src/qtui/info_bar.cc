@@ -27,6 +27,7 @@
 #include <libaudcore/runtime.h>
 #include <libaudqt/libaudqt.h>
 
+#include <QApplication>
 #include <QEvent>
 #include <QPainter>
 
@@ -330,9 +331,31 @@ void InfoBar::update_title ()
     update ();
 }
 
+/* the art is decoded in the background and shown when it is ready */
 void InfoBar::update_album_art ()
 {
-    sd[Cur].art = audqt::art_request_current (ps.IconSize, ps.IconSize);
+    qreal r = qApp->devicePixelRatio ();
+    m_art.request_current (ps.IconSize * r);
+}
+
+void InfoBar::art_ready (QImage && image, void * me_)
+{
+    auto me = (InfoBar *) me_;
+    auto & ps = me->ps;
+
+    if (image.isNull ())
+    {
+        /* no album art, so this only loads the fallback icon */
+        me->sd[Cur].art = audqt::art_request_current (ps.IconSize, ps.IconSize);
+    }
+    else
+    {
+        QPixmap art = QPixmap::fromImage (image);
+        art.setDevicePixelRatio (qApp->devicePixelRatio ());
+        me->sd[Cur].art = std::move (art);
+    }
+
+    me->update ();
 }
 
 void InfoBar::next_song ()
@@ -378,6 +401,7 @@ void InfoBar::playback_ready_cb ()
 
 void InfoBar::playback_stop_cb ()
 {
+    m_art.cancel ();
     next_song ();
     m_stopped = true;
 
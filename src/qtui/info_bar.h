@@ -20,11 +20,14 @@
 #ifndef INFO_BAR_H
 #define INFO_BAR_H
 
+#include <QImage>
 #include <QStaticText>
 #include <QWidget>
 
 #include <libaudcore/hook.h>
 
+#include "../ui-common/art-thumb.h"
+
 class InfoVis;
 struct PixelSizes;
 
@@ -39,6 +42,7 @@ public:
 private:
     void update_title ();
     void update_album_art ();
+    static void art_ready (QImage && image, void * me);
     void next_song ();
     void do_fade ();
 
@@ -58,6 +62,8 @@ private:
     InfoVis * m_vis;
     const PixelSizes & ps;
 
+    ArtThumbLoader<QImage> m_art {art_ready, this};
+
     struct SongData {
         QPixmap art;
         QString orig_title;
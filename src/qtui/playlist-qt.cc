@@ -41,6 +41,7 @@ PlaylistWidget::PlaylistWidget (QWidget * parent, Playlist playlist) :
 {
     /* setting up filtering model */
     proxyModel->setSourceModel (model);
+    proxyModel->setFilterDoneFunc ([this] () { applyFilter (); });
 
     inUpdate = true; /* prevents changing focused row */
     setModel (proxyModel);
@@ -358,11 +359,18 @@ void PlaylistWidget::playlistUpdate ()
         else if (currentPos >= update.before)
             currentPos = -1;
 
+        proxyModel->entriesRemoved (update.before, removed);
+        proxyModel->entriesAdded (update.before, changed);
         model->entriesRemoved (update.before, removed);
         model->entriesAdded (update.before, changed);
     }
     else if (update.level == Playlist::Metadata || update.queue_changed)
+    {
+        if (update.level == Playlist::Metadata)
+            proxyModel->entriesChanged (update.before, changed);
+
         model->entriesChanged (update.before, changed);
+    }
 
     if (update.queue_changed)
     {
@@ -392,20 +400,28 @@ void PlaylistWidget::playlistUpdate ()
 }
 
 void PlaylistWidget::setFilter (const char * text)
+{
+    // The filter is evaluated in the background; applyFilter() is called
+    // once the results are ready.
+    proxyModel->setFilter (text);
+}
+
+void PlaylistWidget::applyFilter ()
 {
     // Save the current focus before filtering
     int focus = m_playlist.get_focus ();
+    int rows = model->rowCount ();
 
     // Empty the model before updating the filter.  This prevents Qt from
     // performing a series of "rows added" or "rows deleted" updates, which can
     // be very slow (worst case O(N^2) complexity) on a large playlist.
-    model->entriesRemoved (0, model->rowCount ());
+    model->entriesRemoved (0, rows);
 
     // Update the filter
-    proxyModel->setFilter (text);
+    proxyModel->applyFilter ();
 
     // Repopulate the model
-    model->entriesAdded (0, m_playlist.n_entries ());
+    model->entriesAdded (0, rows);
 
     // If the previously focused row is no longer visible with the new filter,
     // try to find a nearby one that is, and focus it.
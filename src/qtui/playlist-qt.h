@@ -70,6 +70,7 @@ private:
      QItemSelection & selected, QItemSelection & deselected);
     void updateSelection (int rowsBefore, int rowsAfter);
 
+    void applyFilter ();
     void activate (const QModelIndex & index);
     void contextMenuEvent (QContextMenuEvent * event);
     void keyPressEvent (QKeyEvent * event);
@@ -17,6 +17,9 @@
  * the use of this software.
  */
 
+#include <algorithm>
+#include <atomic>
+
 #include <QApplication>
 #include <QIcon>
 #include <QMimeData>
@@ -307,32 +310,65 @@ QString PlaylistModel::queuePos (int row) const
 
 /* ---------------------------------- */
 
-void PlaylistProxyModel::setFilter (const char * filter)
+#define SEARCH_CHUNK 4096
+
+struct PlaylistProxyModel::BuildJob
 {
-    m_searchTerms = str_list_to_index (filter, " ");
-    invalidateFilter ();
+    std::shared_ptr<Index<String>> folded;
+    int rows = 0;
+    int generation = 0;
+    std::atomic<bool> cancel {false};
+};
+
+struct PlaylistProxyModel::SearchJob
+{
+    std::shared_ptr<Index<String>> folded;
+    Index<String> terms;
+    Index<char> accepted;  /* when narrowing, initially the rows to test */
+    bool narrow = false;
+    int generation = 0;
+    std::atomic<bool> cancel {false};
+};
+
+static String fold_entry (Playlist playlist, int entry)
+{
+    Tuple tuple = playlist.entry_tuple (entry, Playlist::NoWait);
+
+    String title = tuple.get_str (Tuple::Title);
+    String artist = tuple.get_str (Tuple::Artist);
+    String album = tuple.get_str (Tuple::Album);
+
+    /* fields are separated by newlines so that a term cannot span them */
+    StringBuf joined = str_concat ({title ? (const char *) title : "", "\n",
+     artist ? (const char *) artist : "", "\n", album ? (const char *) album : ""});
+
+    return String (str_tolower_utf8 (joined));
 }
 
-bool PlaylistProxyModel::filterAcceptsRow (int source_row, const QModelIndex &) const
+static bool row_matches (const char * folded, const Index<String> & terms)
 {
-    if (! m_searchTerms.len ())
-        return true;
+    for (auto & term : terms)
+    {
+        if (! strstr (folded, term))
+            return false;
+    }
 
-    Tuple tuple = m_playlist.entry_tuple (source_row);
+    return true;
+}
 
-    String strings[] = {
-        tuple.get_str (Tuple::Title),
-        tuple.get_str (Tuple::Artist),
-        tuple.get_str (Tuple::Album)
-    };
+/* true if every row matching old_terms also matches new_terms */
+static bool narrows (const Index<String> & old_terms, const Index<String> & new_terms)
+{
+    if (! old_terms.len ())
+        return false;
 
-    for (auto & term : m_searchTerms)
+    for (auto & old_term : old_terms)
     {
         bool found = false;
 
-        for (auto & s : strings)
+        for (auto & new_term : new_terms)
         {
-            if (s && strstr_nocase_utf8 (s, term))
+            if (strstr (new_term, old_term))
             {
                 found = true;
                 break;
@@ -345,3 +381,291 @@ bool PlaylistProxyModel::filterAcceptsRow (int source_row, const QModelIndex &)
 
     return true;
 }
+
+static void copy_terms (const Index<String> & from, Index<String> & to)
+{
+    to.clear ();
+    for (auto & term : from)
+        to.append (term);
+}
+
+PlaylistProxyModel::~PlaylistProxyModel ()
+{
+    stopSearch ();
+    stopBuild ();
+}
+
+void PlaylistProxyModel::buildIndex ()
+{
+    /* a running build is restarted when it finishes */
+    if (m_buildJob)
+        return;
+
+    auto job = std::make_shared<BuildJob> ();
+    job->rows = sourceModel ()->rowCount ();
+    job->generation = m_generation;
+
+    m_buildJob = job;
+    m_changedStart = m_changedEnd = 0;
+
+    m_buildThread = std::thread ([this, job] ()
+    {
+        auto folded = std::make_shared<Index<String>> ();
+        folded->insert (0, job->rows);
+
+        for (int row = 0; row < job->rows; row ++)
+        {
+            if (! (row % SEARCH_CHUNK) && job->cancel)
+                return;
+
+            (* folded)[row] = fold_entry (m_playlist, row);
+        }
+
+        job->folded = std::move (folded);
+        m_buildDone.queue ([this] () { buildDone (); });
+    });
+}
+
+void PlaylistProxyModel::stopBuild ()
+{
+    if (m_buildJob)
+        m_buildJob->cancel = true;
+
+    if (m_buildThread.joinable ())
+        m_buildThread.join ();
+
+    m_buildJob.reset ();
+    m_buildDone.stop ();
+}
+
+void PlaylistProxyModel::buildDone ()
+{
+    if (m_buildThread.joinable ())
+        m_buildThread.join ();
+
+    auto job = std::move (m_buildJob);
+    if (! job || ! job->folded)
+        return;
+
+    /* rows were added or removed while building; start over */
+    if (job->generation != m_generation)
+    {
+        buildIndex ();
+        return;
+    }
+
+    m_folded = std::move (job->folded);
+    m_generation ++;
+
+    int end = aud::min (m_changedEnd, m_folded->len ());
+    for (int row = m_changedStart; row < end; row ++)
+        (* m_folded)[row] = fold_entry (m_playlist, row);
+
+    m_changedStart = m_changedEnd = 0;
+
+    if (m_pendingTerms.len ())
+        startSearch (narrows (m_searchTerms, m_pendingTerms));
+}
+
+/* copies the index first if a search in progress is still reading it */
+Index<String> & PlaylistProxyModel::writableIndex ()
+{
+    if (m_folded.use_count () > 1)
+    {
+        auto copy = std::make_shared<Index<String>> ();
+        copy->insert (0, m_folded->len ());
+        std::copy (m_folded->begin (), m_folded->end (), copy->begin ());
+        m_folded = std::move (copy);
+    }
+
+    m_generation ++;
+    return * m_folded;
+}
+
+void PlaylistProxyModel::stopSearch ()
+{
+    if (m_job)
+        m_job->cancel = true;
+
+    if (m_thread.joinable ())
+        m_thread.join ();
+
+    m_jobDone.stop ();
+}
+
+void PlaylistProxyModel::startSearch (bool narrow)
+{
+    stopSearch ();
+
+    auto job = std::make_shared<SearchJob> ();
+    job->folded = m_folded;
+    job->narrow = narrow;
+    job->generation = m_generation;
+    copy_terms (m_pendingTerms, job->terms);
+
+    if (narrow)
+        job->accepted.insert (m_accepted.begin (), 0, m_accepted.len ());
+    else
+    {
+        job->accepted.insert (0, m_folded->len ());
+        std::fill (job->accepted.begin (), job->accepted.end (), true);
+    }
+
+    m_job = job;
+
+    m_thread = std::thread ([this, job] ()
+    {
+        const Index<String> & folded = * job->folded;
+        int rows = folded.len ();
+
+        for (int start = 0; start < rows; start += SEARCH_CHUNK)
+        {
+            if (job->cancel)
+                return;
+
+            int end = aud::min (start + SEARCH_CHUNK, rows);
+
+            for (int row = start; row < end; row ++)
+            {
+                if (job->accepted[row])
+                    job->accepted[row] = row_matches (folded[row], job->terms);
+            }
+        }
+
+        m_jobDone.queue ([this] () { searchDone (); });
+    });
+}
+
+void PlaylistProxyModel::searchDone ()
+{
+    if (m_thread.joinable ())
+        m_thread.join ();
+
+    if (! m_job)
+        return;
+
+    /* the playlist changed while searching; start over */
+    if (m_job->generation != m_generation)
+    {
+        startSearch (m_job->narrow);
+        return;
+    }
+
+    if (m_filterDone)
+        m_filterDone ();
+    else
+        applyFilter ();
+}
+
+void PlaylistProxyModel::setFilter (const char * filter)
+{
+    m_pendingTerms = str_list_to_index (str_tolower_utf8 (filter), " ");
+
+    if (! m_pendingTerms.len ())
+    {
+        stopSearch ();
+        m_job.reset (new SearchJob);
+
+        if (m_filterDone)
+            m_filterDone ();
+        else
+            applyFilter ();
+
+        return;
+    }
+
+    if (! m_folded)
+    {
+        /* the search is started when the index is ready */
+        buildIndex ();
+        return;
+    }
+
+    startSearch (narrows (m_searchTerms, m_pendingTerms));
+}
+
+void PlaylistProxyModel::applyFilter ()
+{
+    if (! m_job)
+        return;
+
+    m_searchTerms = std::move (m_job->terms);
+    m_accepted = std::move (m_job->accepted);
+    m_job.reset ();
+
+    invalidateFilter ();
+}
+
+void PlaylistProxyModel::entriesAdded (int row, int count)
+{
+    if (! m_folded && count > 0)
+        m_generation ++;  /* restarts a build in progress */
+
+    if (! m_folded || count < 1)
+        return;
+
+    Index<String> & folded = writableIndex ();
+    folded.insert (row, count);
+
+    for (int i = row; i < row + count; i ++)
+        folded[i] = fold_entry (m_playlist, i);
+
+    if (m_searchTerms.len ())
+    {
+        m_accepted.insert (row, count);
+        for (int i = row; i < row + count; i ++)
+            m_accepted[i] = row_matches (folded[i], m_searchTerms);
+    }
+}
+
+void PlaylistProxyModel::entriesRemoved (int row, int count)
+{
+    if (! m_folded && count > 0)
+        m_generation ++;  /* restarts a build in progress */
+
+    if (! m_folded || count < 1)
+        return;
+
+    writableIndex ().remove (row, count);
+
+    if (m_searchTerms.len ())
+        m_accepted.remove (row, count);
+}
+
+void PlaylistProxyModel::entriesChanged (int row, int count)
+{
+    if (! m_folded && m_buildJob && count > 0)
+    {
+        if (m_changedStart < m_changedEnd)
+        {
+            m_changedStart = aud::min (m_changedStart, row);
+            m_changedEnd = aud::max (m_changedEnd, row + count);
+        }
+        else
+        {
+            m_changedStart = row;
+            m_changedEnd = row + count;
+        }
+    }
+
+    if (! m_folded || count < 1)
+        return;
+
+    Index<String> & folded = writableIndex ();
+
+    for (int i = row; i < row + count; i ++)
+    {
+        folded[i] = fold_entry (m_playlist, i);
+
+        if (m_searchTerms.len ())
+            m_accepted[i] = row_matches (folded[i], m_searchTerms);
+    }
+}
+
+bool PlaylistProxyModel::filterAcceptsRow (int source_row, const QModelIndex &) const
+{
+    if (! m_searchTerms.len ())
+        return true;
+
+    return source_row < m_accepted.len () && m_accepted[source_row];
+}
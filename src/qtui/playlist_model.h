@@ -20,9 +20,14 @@
 #ifndef PLAYLIST_MODEL_H
 #define PLAYLIST_MODEL_H
 
+#include <functional>
+#include <memory>
+#include <thread>
+
 #include <QAbstractListModel>
 #include <QSortFilterProxyModel>
 
+#include <libaudcore/mainloop.h>
 #include <libaudcore/playlist.h>
 
 class PlaylistModel : public QAbstractListModel
@@ -77,6 +82,15 @@ private:
     QString queuePos (int row) const;
 };
 
+/* Filtering is done against a per-playlist index of case-folded title,
+ * artist, and album strings, kept up to date by the entries* methods (which
+ * must be called before the corresponding PlaylistModel methods).  The
+ * index is built on a worker thread when a filter is first set, and the
+ * search starts once it is ready.  A new filter is evaluated in chunks on
+ * a worker thread; when the query only narrows the previous one, just the
+ * previously matching rows are tested.
+ * The onFilterDone callback is invoked in the main thread when the results
+ * are ready to be applied with applyFilter(). */
 class PlaylistProxyModel : public QSortFilterProxyModel
 {
 public:
@@ -84,13 +98,55 @@ public:
         QSortFilterProxyModel (parent),
         m_playlist (playlist) {}
 
+    ~PlaylistProxyModel ();
+
     void setFilter (const char * filter);
+    void applyFilter ();
+
+    void setFilterDoneFunc (std::function<void ()> func)
+        { m_filterDone = func; }
+
+    void entriesAdded (int row, int count);
+    void entriesRemoved (int row, int count);
+    void entriesChanged (int row, int count);
 
 private:
+    struct BuildJob;
+    struct SearchJob;
+
     bool filterAcceptsRow (int source_row, const QModelIndex &) const;
 
+    void buildIndex ();
+    void stopBuild ();
+    void buildDone ();
+    Index<String> & writableIndex ();
+    void startSearch (bool narrow);
+    void stopSearch ();
+    void searchDone ();
+
     Playlist m_playlist;
+    std::function<void ()> m_filterDone;
+
+    /* folded search strings, shared read-only with the worker thread */
+    std::shared_ptr<Index<String>> m_folded;
+    int m_generation = 0;
+
+    /* index being built, and rows changed meanwhile (which are folded
+     * again when it is done) */
+    std::shared_ptr<BuildJob> m_buildJob;
+    std::thread m_buildThread;
+    QueuedFunc m_buildDone;
+    int m_changedStart = 0, m_changedEnd = 0;
+
+    /* currently applied filter and which rows it accepts */
     Index<String> m_searchTerms;
+    Index<char> m_accepted;
+
+    /* filter being computed */
+    Index<String> m_pendingTerms;
+    std::shared_ptr<SearchJob> m_job;
+    std::thread m_thread;
+    QueuedFunc m_jobDone;
 };
 
 #endif
@@ -18,6 +18,7 @@
 
 //audacious includes
 #include <libaudcore/i18n.h>
+#include <libaudcore/index.h>
 #include <libaudcore/preferences.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/tuple.h>
@@ -88,6 +89,16 @@ extern gboolean read_authentication_test_result(String &error_code, String &erro
 extern gboolean read_token(String &error_code, String &error_detail);
 extern gboolean read_session_key(String &error_code, String &error_detail);
 extern gboolean read_scrobble_result(String &error_code, String &error_detail, gboolean *ignored, String &ignored_code);
+extern gboolean read_scrobble_batch_result(String &error_code, String &error_detail, Index<String> &ignored_codes);
+
+//scrobbler_queue.c
+typedef struct {
+    Index<String> fields; //the tab-separated fields of the line; none if it was too long
+    int64_t end;          //offset in scrobbler.log of the next line
+} QueuedScrobble;
+
+extern int64_t scrobbler_queue_read(Index<QueuedScrobble> &entries, int max);
+extern bool scrobbler_queue_commit(int64_t offset, const Index<String> &requeue);
 
 //scrobbler.c
 extern StringBuf clean_string(const char *string);
@@ -20,6 +20,19 @@ typedef struct {
 
 static CURL *curlHandle = nullptr;     //global handle holding cURL options
 
+//The queue is submitted in batches of up to SCROBBLE_BATCH_SIZE tracks (the
+//most track.scrobble accepts), at most one batch per SCROBBLE_INTERVAL.
+//When last.fm is unavailable, the wait doubles from SCROBBLE_MIN_RETRY up
+//to SCROBBLE_MAX_RETRY seconds.
+#define SCROBBLE_BATCH_SIZE 50
+#define SCROBBLE_INTERVAL (G_USEC_PER_SEC / 2)
+#define SCROBBLE_MIN_RETRY 30
+#define SCROBBLE_MAX_RETRY 3600
+
+static int64_t next_scrobble_time = 0;      //monotonic time, in microseconds
+static int scrobble_retry_delay = 0;        //in seconds
+static int64_t single_scrobbles_until = 0;  //offset in the queue up to which tracks are sent one at a time
+
 gboolean scrobbling_enabled = true;
 
 //shared variables
@@ -66,10 +79,39 @@ static char * scrobbler_get_signature (Index<API_Parameter> & params)
     return g_compute_checksum_for_string (G_CHECKSUM_MD5, buf, -1);
 }
 
+/*
+ * Builds a request for the given method and parameters. api_sig
+ * (checksum) is always included, be it necessary or not.
+ */
+static String create_message_from_params (const char * method_name, Index<API_Parameter> & params)
+{
+    StringBuf buf = str_concat ({"method=", method_name});
+
+    for (const API_Parameter & param : params)
+    {
+        char * esc = curl_easy_escape (curlHandle, param.argument, 0);
+        buf.insert (-1, "&");
+        buf.insert (-1, param.paramName);
+        buf.insert (-1, "=");
+        buf.insert (-1, esc);
+        curl_free (esc);
+    }
+
+    params.append (String ("method"), String (method_name));
+
+    char * api_sig = scrobbler_get_signature (params);
+    buf.insert (-1, "&api_sig=");
+    buf.insert (-1, api_sig);
+    g_free (api_sig);
+
+    AUDDBG ("FINAL message: %s.\n", (const char *) buf);
+
+    return String (buf);
+}
+
 /*
  * n_args should count with the given authentication parameters
  * At most 2: api_key, session_key.
- * api_sig (checksum) is always included, be it necessary or not
  * Example usage:
  *   create_message_to_lastfm("track.scrobble", 5
  *        "artist", "Artist Name", "track", "Track Name", "timestamp", time(nullptr),
@@ -80,9 +122,6 @@ static char * scrobbler_get_signature (Index<API_Parameter> & params)
 static String create_message_to_lastfm (const char * method_name, int n_args, ...)
 {
     Index<API_Parameter> params;
-    params.append (String ("method"), String (method_name));
-
-    StringBuf buf = str_concat ({"method=", method_name});
 
     va_list vl;
     va_start (vl, n_args);
@@ -93,25 +132,11 @@ static String create_message_to_lastfm (const char * method_name, int n_args, ..
         const char * arg = va_arg (vl, const char *);
 
         params.append (String (name), String (arg));
-
-        char * esc = curl_easy_escape (curlHandle, arg, 0);
-        buf.insert (-1, "&");
-        buf.insert (-1, name);
-        buf.insert (-1, "=");
-        buf.insert (-1, esc);
-        curl_free (esc);
     }
 
     va_end (vl);
 
-    char * api_sig = scrobbler_get_signature (params);
-    buf.insert (-1, "&api_sig=");
-    buf.insert (-1, api_sig);
-    g_free (api_sig);
-
-    AUDDBG ("FINAL message: %s.\n", (const char *) buf);
-
-    return String (buf);
+    return create_message_from_params (method_name, params);
 }
 
 static gboolean send_message_to_lastfm (const char * data)
@@ -266,7 +291,9 @@ gboolean scrobbler_communication_init() {
         return false;
     }
 
-    curl_requests_result = curl_easy_setopt(curlHandle, CURLOPT_URL, SCROBBLER_URL);
+    //the server can be overridden to test against a local one
+    const char *url = g_getenv("SCROBBLER_API_URL");
+    curl_requests_result = curl_easy_setopt(curlHandle, CURLOPT_URL, url ? url : SCROBBLER_URL);
     if (curl_requests_result != CURLE_OK) {
         AUDDBG("Could not define scrobbler destination URL: %s.\n", curl_easy_strerror(curl_requests_result));
         return false;
@@ -281,207 +308,147 @@ gboolean scrobbler_communication_init() {
     return true;
 }
 
-static void set_timestamp_to_current(char **line) {
-    //line[0] line[1] line[2] line[3] line[4] line[5] line[6]   line[7]
-    //artist  album   title   number  length  "L"     timestamp nullptr
-
-    char **splitted_line = g_strsplit(*line, "\t", 0);
-    g_free(splitted_line[6]);
-    splitted_line[6] = g_strdup_printf("%" G_GINT64_FORMAT, g_get_real_time() / G_USEC_PER_SEC);
-    AUDDBG("splitted line's timestamp is now: %s.\n", splitted_line[6]);
-    g_free(*line);
-    (*line) = g_strjoinv("\t", splitted_line);
-    g_strfreev(splitted_line);
+static void scrobble_backoff (int64_t now) {
+    scrobble_retry_delay = aud::clamp(scrobble_retry_delay * 2, SCROBBLE_MIN_RETRY, SCROBBLE_MAX_RETRY);
+    next_scrobble_time = now + (int64_t) scrobble_retry_delay * G_USEC_PER_SEC;
+    AUDINFO("Retrying scrobbles in %d seconds.\n", scrobble_retry_delay);
 }
 
-static void delete_lines_from_scrobble_log (GSList **lines_to_remove_ptr, GSList **lines_to_retry_ptr, char *queuepath) {
-    GSList *lines_to_remove = *lines_to_remove_ptr;
-    GSList *lines_to_retry = *lines_to_retry_ptr;
-    char *contents = nullptr;
-    char **lines = nullptr;
-    char **finallines = g_new (char *, 1);
-    int n_finallines;
+//line[0] line[1] line[2] line[3] line[4] line[5] line[6]
+//artist  album   title   number  length  "L"     timestamp
+static String make_queue_line (const Index<String> &line, const char *timestamp) {
+    return String(str_printf("%s\t%s\t%s\t%s\t%s\tL\t%s", (const char *)line[0],
+     (const char *)line[1], (const char *)line[2], (const char *)line[3],
+     (const char *)line[4], timestamp));
+}
 
-    if (lines_to_remove != nullptr) {
-        lines_to_remove = g_slist_reverse(lines_to_remove);
-    }
-    if (lines_to_retry != nullptr) {
-        lines_to_retry = g_slist_reverse(lines_to_retry);
+/*
+ * Submits the next batch of tracks from the queue, unless it is too early to.
+ * Returns the (monotonic) time at which it should be called again, or 0 if
+ * there is nothing more to do until a track is queued.
+ */
+static int64_t scrobble_cached_queue() {
+
+    int64_t now = g_get_monotonic_time();
+    if (now < next_scrobble_time) {
+        return next_scrobble_time;
     }
 
+    Index<QueuedScrobble> entries;
+    int64_t start = scrobbler_queue_read(entries, SCROBBLE_BATCH_SIZE);
 
-    pthread_mutex_lock(&log_access_mutex);
+    if (!entries.len()) {
+        return 0;
+    }
 
-    gboolean success = g_file_get_contents(queuepath, &contents, nullptr, nullptr);
-    if (!success) {
-        AUDDBG("Could not read scrobbler.log contents.\n");
-    } else {
-        lines = g_strsplit(contents, "\n", 0);
+    if (start < single_scrobbles_until) {
+        entries.remove(1, -1);
+    }
 
-        n_finallines = 0;
-        for (int i = 0 ; lines[i] != nullptr && strlen(lines[i]) > 0; i++) {
-            if (lines_to_remove != nullptr && *((int *) (lines_to_remove->data)) == i) {
-                //this line is to remove
-                lines_to_remove = g_slist_next(lines_to_remove);
-            } else {
-                //keep this line
-                AUDDBG("Going to keep line %i\n", i);
-                if (lines_to_retry != nullptr && *((int *) (lines_to_retry->data)) == i) {
-                  lines_to_retry = g_slist_next(lines_to_retry);
-                  //this line will be retried with a zero timestamp
-                  AUDDBG("Going to zero this line.\n");
-                  AUDDBG("Line before: %s.\n", lines[i]);
-                  set_timestamp_to_current(&(lines[i]));
-                  AUDDBG("Line after: %s.\n", lines[i]);
+    int64_t end = entries[entries.len()-1].end;
 
-                } else {
-                  AUDDBG("not zeroing this line\n");
-                }
-                n_finallines++;
-                finallines = g_renew (char *, finallines, n_finallines);
-                finallines[n_finallines-1] = g_strdup(lines[i]);
-            }
-        }
+    Index<API_Parameter> params;
+    Index<int> sent; //the entries sent, in the order they were sent
 
-        finallines = g_renew (char *, finallines, n_finallines + 2);
-        finallines[n_finallines] = g_strdup("");
-        finallines[n_finallines+1] = nullptr;
-        g_free(contents);
-        contents = g_strjoinv("\n", finallines);
-        success = g_file_set_contents(queuepath, contents, -1, nullptr);
-        if (!success) {
-            AUDERR("Could not write to scrobbler.log!\n");
+    for (int i = 0; i < entries.len(); i++) {
+        const Index<String> &line = entries[i].fields;
+
+        if (line.len() != 7 || strcmp(line[5], "L") != 0) {
+            AUDDBG("Unscrobbable line.\n");
+            continue;
         }
 
+        int n = sent.len();
+        params.append(String(str_printf("artist[%d]", n)), line[0]);
+        params.append(String(str_printf("album[%d]", n)), line[1]);
+        params.append(String(str_printf("track[%d]", n)), line[2]);
+        params.append(String(str_printf("trackNumber[%d]", n)), line[3]);
+        params.append(String(str_printf("duration[%d]", n)), line[4]);
+        params.append(String(str_printf("timestamp[%d]", n)), line[6]);
+        sent.append(i);
     }
 
-    pthread_mutex_unlock(&log_access_mutex);
+    Index<String> requeue; //tracks to retry later
+    bool limit_reached = false;
 
+    if (sent.len()) {
+        params.append(String("api_key"), String(SCROBBLER_API_KEY));
+        params.append(String("sk"), session_key);
 
-    g_strfreev(finallines);
-    g_strfreev(lines);
-    g_free(contents);
-}
+        String scrobblemsg = create_message_from_params("track.scrobble", params);
 
-static void save_line_to_remove(GSList **lines_to_remove, int linenumber) {
-    int *rem = g_new (int, 1);
-    *rem = linenumber;
-    (*lines_to_remove) = g_slist_prepend((*lines_to_remove), rem);
-}
-
-static void scrobble_cached_queue() {
-
-    char *queuepath = g_build_filename(aud_get_path(AudPath::UserDir),"scrobbler.log", nullptr);
-    char *contents = nullptr;
-    gboolean success;
-    char **lines = nullptr;
-    char **line;
-    GSList *lines_to_remove = nullptr; //lines to remove because they were scrobbled (or ignored, and will not be retried)
-    GSList *lines_to_retry = nullptr; //lines to retry later because they were too old TODO: or "daily scrobble limit reached"
-
-    pthread_mutex_lock(&log_access_mutex);
-    success = g_file_get_contents(queuepath, &contents, nullptr, nullptr);
-    pthread_mutex_unlock(&log_access_mutex);
-    if (!success) {
-        AUDDBG("Couldn't access the queue file.\n");
-    } else {
+        if (send_message_to_lastfm(scrobblemsg) == false) {
+            AUDDBG("Could not scrobble the tracks on the queue. Network problem?\n");
+            //scrobbles to be retried
+            scrobbling_enabled = false;
+            return 0;
+        }
 
-        lines = g_strsplit(contents, "\n", 0);
-
-        for (int i = 0; lines[i] != nullptr && strlen(lines[i]) > 0 && scrobbling_enabled; i++) {
-            line = g_strsplit(lines[i], "\t", 0);
-
-            //line[0] line[1] line[2] line[3] line[4] line[5] line[6]   line[7]
-            //artist  album   title   number  length  "L"     timestamp nullptr
-
-            if (line[0] && line[2] && (strcmp(line[5], "L") == 0) && line[6] && (line[7] == nullptr))
-            {
-                String scrobblemsg = create_message_to_lastfm ("track.scrobble",
-                 8, "artist", line[0], "album", line[1], "track", line[2],
-                 "trackNumber", line[3], "duration", line[4],
-                 "timestamp", line[6], "api_key", SCROBBLER_API_KEY,
-                 "sk", (const char *) session_key);
-
-                if (send_message_to_lastfm(scrobblemsg) == true) {
-                    String error_code;
-                    String error_detail;
-                    gboolean ignored = false;
-                    String ignored_code;
-
-                    if (read_scrobble_result(error_code, error_detail, &ignored, ignored_code) == true) {
-                        AUDDBG("SCROBBLE OK. Error code: %s. Error detail: %s\n",
-                         (const char *)error_code, (const char *)error_detail);
-                        AUDDBG("SCROBBLE OK. ignored: %i.\n", ignored);
-                        AUDDBG("SCROBBLE OK. ignored code: %s.\n",
-                         (const char *)ignored_code);
-                        if (ignored == true && g_strcmp0(ignored_code, "3") == 0) { //3: Timestamp was too old
-                            AUDDBG("SCROBBLE IGNORED!!! %i, detail: %s\n",
-                             ignored, (const char *)ignored_code);
-                            save_line_to_remove(&lines_to_retry, i);
-                        } else if (ignored == true && g_strcmp0(ignored_code, "") == 0) { //5: Daily scrobble limit reached
-                           //TODO: a track might not be scrobbled due to "daily scrobble limit exeeded".
-                           //This message comes on the ignoredMessage attribute, inside the XML of the response.
-                           //We are not dealing with this case currently and are losing that scrobble.
-                           //TODO
-
-                        } else {
-                            AUDDBG("Not ignored. Carrying on...\n");
-                            save_line_to_remove(&lines_to_remove, i);
-                        }
-                    } else {
-                        AUDINFO("SCROBBLE NOT OK. Error code: %s. Error detail: %s.\n",
-                         (const char *)error_code, (const char *)error_detail);
-
-                        if (! error_code) { //net error(?) or the answer from last.fm was not well read
-                            //scrobble to be retried
-                        }
-                        else if (g_strcmp0(error_code, "11") == 0 ||
-                                 g_strcmp0(error_code, "16") == 0){
-                            //error code 11: Service Offline - This service is temporarily offline. Try again later.
-                            //error code 16: The service is temporarily unavailable, please try again.
-                            //scrobble to be retried
-                        }
-                        else if (g_strcmp0(error_code,  "9") == 0) {
-                            //Bad Session. Reauth.
-                            scrobbling_enabled = false;
-                            session_key = String();
-                            aud_set_str("scrobbler", "session_key", "");
-                        }
-                        else {
-                            save_line_to_remove(&lines_to_remove, i);
-                        }
-                    }
-                } else {
-                    AUDDBG("Could not scrobble a track on the queue. Network problem?\n");
-                    //scrobble to be retried
-                    scrobbling_enabled = false;
+        String error_code;
+        String error_detail;
+        Index<String> ignored_codes;
+
+        if (read_scrobble_batch_result(error_code, error_detail, ignored_codes) == true) {
+            scrobble_retry_delay = 0;
+
+            for (int n = 0; n < sent.len() && n < ignored_codes.len(); n++) {
+                const Index<String> &line = entries[sent[n]].fields;
+
+                if (strcmp(ignored_codes[n], "3") == 0) {
+                    //3: Timestamp was too old; retry it as if just played
+                    AUDDBG("SCROBBLE IGNORED! Timestamp too old.\n");
+                    requeue.append(make_queue_line(line, str_printf("%" G_GINT64_FORMAT,
+                     g_get_real_time() / G_USEC_PER_SEC)));
+                } else if (strcmp(ignored_codes[n], "5") == 0) {
+                    //5: Daily scrobble limit reached
+                    AUDDBG("SCROBBLE IGNORED! Daily scrobble limit reached.\n");
+                    requeue.append(make_queue_line(line, line[6]));
+                    limit_reached = true;
                 }
-
-                //TODO: Avoid spamming last.fm --- It's not as simple as just adding a wait here:
-                //If audacious is closed while we're on this loop, tracks might be re-scrobbled.
-                //This shall be doable if we only pick one track at a time from the scrobbler.log
-            } else {
-                AUDDBG("Unscrobbable line.\n");
-                //leave entry on the cache file
             }
-            g_strfreev(line);
-        }//for
-
-
-        delete_lines_from_scrobble_log(&lines_to_remove, &lines_to_retry, queuepath);
-
-        if (lines_to_remove != nullptr) {
-            g_slist_free_full(lines_to_remove, g_free);
-        }
-        if (lines_to_retry != nullptr) {
-            g_slist_free_full(lines_to_retry, g_free);
+        } else {
+            AUDINFO("SCROBBLE NOT OK. Error code: %s. Error detail: %s.\n",
+             (const char *)error_code, (const char *)error_detail);
+
+            if (! error_code || //net error(?) or the answer from last.fm was not well read
+                g_strcmp0(error_code, "11") == 0 || //Service Offline - This service is temporarily offline. Try again later.
+                g_strcmp0(error_code, "16") == 0 || //The service is temporarily unavailable, please try again.
+                g_strcmp0(error_code, "29") == 0) { //Rate limit exceeded
+                //scrobbles to be retried
+                scrobble_backoff(now);
+                return next_scrobble_time;
+            }
+            else if (g_strcmp0(error_code, "9") == 0) {
+                //Bad Session. Reauth.
+                scrobbling_enabled = false;
+                session_key = String();
+                aud_set_str("scrobbler", "session_key", "");
+                return 0;
+            }
+            else if (sent.len() > 1) {
+                //the request was rejected; send these tracks one at a time to
+                //drop only the offending one
+                single_scrobbles_until = end;
+                next_scrobble_time = now + SCROBBLE_INTERVAL;
+                return next_scrobble_time;
+            }
+            //else the track is dropped
         }
+    }
+
+    if (scrobbler_queue_commit(end, requeue)) {
+        //the rest of the queue has moved to the start of the file
+        single_scrobbles_until = MAX(single_scrobbles_until - end, 0);
+    }
 
-        g_strfreev(lines);
+    if (limit_reached) {
+        scrobble_retry_delay = SCROBBLE_MAX_RETRY;
+        next_scrobble_time = now + (int64_t) SCROBBLE_MAX_RETRY * G_USEC_PER_SEC;
+    } else {
+        next_scrobble_time = now + SCROBBLE_INTERVAL;
     }
 
-    g_free(contents);
-    g_free(queuepath);
+    return next_scrobble_time;
 }
 
 
@@ -657,13 +624,23 @@ void * scrobbling_thread (void * input_data) {
             now_playing_requested = false;
 
         } else {
+            int64_t wait_until = 0;
             if (scrobbling_enabled) {
-              scrobble_cached_queue();
+              wait_until = scrobble_cached_queue();
             }
             //scrobbling may be disabled at this point if communication errors occur
 
             pthread_mutex_lock(&communication_mutex);
-            if (scrobbling_enabled) {
+            if (scrobbling_enabled && wait_until) {
+                //more to submit, or waiting to retry
+                int64_t deadline = g_get_real_time() + (wait_until - g_get_monotonic_time());
+                struct timespec timeout;
+                timeout.tv_sec = deadline / G_USEC_PER_SEC;
+                timeout.tv_nsec = (deadline % G_USEC_PER_SEC) * 1000;
+                pthread_cond_timedwait(&communication_signal, &communication_mutex, &timeout);
+                pthread_mutex_unlock(&communication_mutex);
+            }
+            else if (scrobbling_enabled) {
                 pthread_cond_wait(&communication_signal, &communication_mutex);
                 pthread_mutex_unlock(&communication_mutex);
             }
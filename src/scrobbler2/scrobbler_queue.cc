@@ -0,0 +1,211 @@
+//external includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <libaudcore/audstrings.h>
+
+//plugin includes
+#include "scrobbler.h"
+
+/*
+ * The queue of tracks to scrobble is scrobbler.log, to which played tracks
+ * are only ever appended (see queue_track_to_scrobble).  The tracks that
+ * have already been submitted are not removed from it right away; instead,
+ * scrobbler.index holds the offset in scrobbler.log of the first track not
+ * submitted yet.  Only once most of the file has been submitted is it
+ * rewritten without those tracks.
+ */
+
+//scrobbler.log is only rewritten when this much of it has been submitted
+#define COMPACT_MIN_SIZE 65536
+
+//longer lines are not tracks we have written
+#define MAX_LINE_LENGTH 4096
+
+static StringBuf queue_path () {
+    return filename_build({aud_get_path(AudPath::UserDir), "scrobbler.log"});
+}
+
+static StringBuf index_path () {
+    return filename_build({aud_get_path(AudPath::UserDir), "scrobbler.index"});
+}
+
+static int64_t read_index () {
+    char *contents = nullptr;
+    int64_t offset = 0;
+
+    if (g_file_get_contents(index_path(), &contents, nullptr, nullptr)) {
+        offset = g_ascii_strtoll(contents, nullptr, 10);
+        g_free(contents);
+    }
+
+    return offset;
+}
+
+static void write_index (int64_t offset) {
+    StringBuf contents = str_printf("%" G_GINT64_FORMAT "\n", offset);
+
+    if (!g_file_set_contents(index_path(), contents, -1, nullptr)) {
+        AUDERR("Could not write to scrobbler.index!\n");
+    }
+}
+
+/*
+ * Reads up to max tracks that have not been submitted yet into entries.
+ * Returns the offset in scrobbler.log of the first one.
+ */
+int64_t scrobbler_queue_read (Index<QueuedScrobble> &entries, int max) {
+    entries.clear();
+
+    pthread_mutex_lock(&log_access_mutex);
+
+    int64_t offset = read_index();
+    int64_t start = offset;
+    FILE *f = g_fopen(queue_path(), "r");
+
+    if (f == nullptr) {
+        AUDDBG("Couldn't access the queue file.\n");
+    } else {
+        fseek(f, 0, SEEK_END);
+        if (offset > ftell(f)) {
+            //scrobbler.log was replaced behind our back
+            AUDWARN("scrobbler.index does not match scrobbler.log; starting over.\n");
+            offset = start = 0;
+        }
+        fseek(f, offset, SEEK_SET);
+
+        char line[MAX_LINE_LENGTH];
+
+        while (entries.len() < max && fgets(line, sizeof line, f)) {
+            int len = strlen(line);
+            int64_t end = offset + len;
+            bool complete = (len > 0 && line[len-1] == '\n');
+            bool too_long = false;
+
+            //skip over the rest of an overlong line
+            char rest[MAX_LINE_LENGTH];
+            while (!complete && len == sizeof line - 1 && fgets(rest, sizeof rest, f)) {
+                int rest_len = strlen(rest);
+                end += rest_len;
+                complete = (rest_len > 0 && rest[rest_len-1] == '\n');
+                too_long = true;
+            }
+
+            //a line without a newline has not been written completely
+            if (!complete)
+                break;
+
+            line[len-1] = 0;
+            offset = end;
+
+            QueuedScrobble &entry = entries.append();
+            entry.end = end;
+
+            if (!too_long) {
+                //line[0] line[1] line[2] line[3] line[4] line[5] line[6]
+                //artist  album   title   number  length  "L"     timestamp
+                char **fields = g_strsplit(line, "\t", 0);
+                for (int i = 0; fields[i]; i++)
+                    entry.fields.append(String(fields[i]));
+                g_strfreev(fields);
+            }
+        }
+
+        fclose(f);
+    }
+
+    pthread_mutex_unlock(&log_access_mutex);
+
+    return start;
+}
+
+//called with log_access_mutex held
+//returns false if scrobbler.log was left as it was
+static bool compact_queue (const char *path, int64_t offset, int64_t size) {
+    Index<char> rest;
+
+    if (offset < size) {
+        FILE *f = g_fopen(path, "r");
+        if (f == nullptr) {
+            AUDERR("Could not read scrobbler.log!\n");
+            return false;
+        }
+
+        rest.insert(0, size - offset);
+        fseek(f, offset, SEEK_SET);
+        size_t read = fread(rest.begin(), 1, rest.len(), f);
+        fclose(f);
+
+        if (read != (size_t) rest.len()) {
+            AUDERR("Could not read scrobbler.log!\n");
+            return false;
+        }
+    }
+
+    //the rest is written to a new file that then replaces scrobbler.log, and
+    //the index is only reset once that has worked; until then, the old file
+    //and index still describe the queue
+    StringBuf temp = str_concat({path, ".tmp"});
+    FILE *f = g_fopen(temp, "w");
+    bool written = false;
+
+    if (f != nullptr) {
+        written = (fwrite(rest.begin(), 1, rest.len(), f) == (size_t) rest.len());
+        written = (fclose(f) == 0) && written;
+    }
+
+    if (!written || g_rename(temp, path) < 0) {
+        AUDERR("Could not write to scrobbler.log!\n");
+        g_unlink(temp);
+        return false;
+    }
+
+    write_index(0);
+    return true;
+}
+
+/*
+ * Marks the tracks before offset in scrobbler.log as submitted.  The lines
+ * in requeue (tracks that are to be retried) are added at the end of the
+ * queue first.  Returns true if the submitted tracks were cut from the file,
+ * which moves the remaining ones back by offset.
+ */
+bool scrobbler_queue_commit (int64_t offset, const Index<String> &requeue) {
+    StringBuf path = queue_path();
+    bool compacted = false;
+
+    pthread_mutex_lock(&log_access_mutex);
+
+    if (requeue.len()) {
+        FILE *f = g_fopen(path, "a");
+        if (f == nullptr) {
+            perror("fopen");
+        } else {
+            for (const String &line : requeue) {
+                if (fprintf(f, "%s\n", (const char *)line) < 0) {
+                    perror("fprintf");
+                }
+            }
+            fclose(f);
+        }
+    }
+
+    GStatBuf info;
+    int64_t size = (g_stat(path, &info) == 0) ? info.st_size : 0;
+
+    if (offset >= size || (offset >= COMPACT_MIN_SIZE && offset * 2 >= size)) {
+        compacted = compact_queue(path, offset, size);
+    }
+
+    //if scrobbler.log could not be rewritten, just skip the submitted tracks
+    if (!compacted) {
+        write_index(offset);
+    }
+
+    pthread_mutex_unlock(&log_access_mutex);
+    return compacted;
+}
@@ -185,6 +185,55 @@ gboolean read_scrobble_result(String &error_code, String &error_detail,
     return result;
 }
 
+/*
+ * Like read_scrobble_result, for a track.scrobble request with several
+ * tracks. On success, the code of the ignoredMessage of each track is
+ * appended to ignored_codes, in the order the tracks were sent ("0" if the
+ * track was accepted).
+ */
+gboolean read_scrobble_batch_result(String &error_code, String &error_detail,
+ Index<String> &ignored_codes) {
+
+    gboolean result = true;
+
+    if (!prepare_data()) {
+        AUDDBG("Could not read received data from last.fm. What's up?\n");
+        return false;
+    }
+
+    String status = check_status(error_code, error_detail);
+
+    if (!status) {
+        AUDDBG("Status was nullptr. Invalid API answer.\n");
+        clean_data();
+        return false;
+    }
+
+    if (!strcmp(status, "failed")) {
+        AUDDBG("Error code: %s. Detail: %s.\n", (const char *)error_code,
+         (const char *)error_detail);
+        result = false;
+
+    } else {
+        xmlXPathObjectPtr messages = xmlXPathEvalExpression((xmlChar *)
+         "/lfm/scrobbles/scrobble/ignoredMessage", context);
+
+        if (messages != nullptr && !xmlXPathNodeSetIsEmpty(messages->nodesetval)) {
+            for (int i = 0; i < messages->nodesetval->nodeNr; i++) {
+                xmlChar *code = xmlGetProp(messages->nodesetval->nodeTab[i], (xmlChar *) "code");
+                ignored_codes.append(String((code && code[0]) ? (const char *)code : "0"));
+                xmlFree(code);
+            }
+        }
+
+        xmlXPathFreeObject(messages);
+        AUDDBG("%d scrobble results read.\n", ignored_codes.len());
+    }
+
+    clean_data();
+    return result;
+}
+
 //returns
 //FALSE if there was an error with the connection
 gboolean read_authentication_test_result (String &error_code, String &error_detail) {
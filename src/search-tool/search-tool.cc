@@ -17,7 +17,14 @@
  * the use of this software.
  */
 
+#include <stdint.h>
 #include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+
 #include <gtk/gtk.h>
 #include <gdk/gdk.h>
 
@@ -35,8 +42,13 @@
 #include <libaudgui/list.h>
 #include <libaudgui/menu.h>
 
+#include "watch.h"
+
 #define CFG_ID "search-tool"
 #define SEARCH_DELAY 300
+#define BUILD_CHUNK 1024
+#define GRAM_PAD 1 /* pads names so that every short term is a trigram prefix */
+#define GRAM_PASS_SIZE (1 << 20) /* trigrams sorted at once when indexing */
 
 class SearchTool : public GeneralPlugin
 {
@@ -63,10 +75,12 @@ public:
 EXPORT SearchTool aud_plugin_instance;
 
 static void trigger_search ();
+static void watch_changed ();
 
 const char * const SearchTool::defaults[] = {
     "max_results", "20",
     "rescan_on_startup", "FALSE",
+    "watch", "FALSE",
     nullptr
 };
 
@@ -75,7 +89,9 @@ const PreferencesWidget SearchTool::widgets[] = {
         WidgetInt (CFG_ID, "max_results", trigger_search),
          {10, 10000, 10}),
     WidgetCheck (N_("Rescan library at startup"),
-        WidgetBool (CFG_ID, "rescan_on_startup"))
+        WidgetBool (CFG_ID, "rescan_on_startup")),
+    WidgetCheck (N_("Watch library folder for changes"),
+        WidgetBool (CFG_ID, "watch", watch_changed))
 };
 
 const PluginPreferences SearchTool::prefs = {{widgets}};
@@ -107,19 +123,91 @@ struct Item
     SimpleHash<Key, Item> children;
     Index<int> matches;
 
-    Item (SearchField field, const String & name, Item * parent) :
+    Item (SearchField field, const String & name, const String & folded, Item * parent) :
         field (field),
         name (name),
-        folded (str_tolower_utf8 (name)),
+        folded (folded),
         parent (parent) {}
 
     Item (Item &&) = default;
     Item & operator= (Item &&) = default;
 };
 
+/* Search fields of one playlist entry, case-folded once when they change */
+struct EntryInfo
+{
+    String filename;
+    aud::array<SearchField, String> names, folded;
+};
+
+/* The database is built on a worker thread from a snapshot of the entry
+ * list and handed to the UI thread as a whole; it is not modified after
+ * that.  Item::matches refer to entry numbers at the time of the snapshot,
+ * so the filenames are kept to detect entries that have moved since.
+ *
+ * Items are numbered depth-first, so that the descendants of items[i] are
+ * items[i + 1] up to items[subtree_end[i] - 1].  A sorted list of the byte
+ * trigrams of all folded names maps each trigram grams[g] to a posting list
+ * of the items containing it, in ascending order.  The lists are stored one
+ * after another in postings, starting at gram_offset[g], as the differences
+ * between successive item numbers in a variable-length encoding (7 bits per
+ * byte); gram_start[g] is the number of items in the lists before it.  Names
+ * are padded at the end so that terms of one or two bytes are prefixes of
+ * some trigram and can be looked up as a range of the sorted list.  The folded
+ * names are copied one after another into a single buffer, so that checking
+ * many candidates does not touch the items themselves.
+ *
+ * The items that can be listed are also kept in the order in which they are
+ * listed (most songs first), with the number of them before each item. */
+struct Database
+{
+    SimpleHash<Key, Item> tree;
+    Index<String> filenames;
+
+    Index<const Item *> items;
+    Index<int> subtree_end;
+
+    Index<unsigned> grams;
+    Index<int> gram_start;
+    Index<int> gram_offset;
+    Index<unsigned char> postings;
+
+    Index<char> names;
+    Index<int> name_start;
+
+    Index<int> ranked;
+    Index<int> listable_before;
+};
+
+/* a range of item numbers, or of trigrams */
+struct Range
+{
+    int start, end;
+};
+
+/* items whose own folded name contains the term, in ascending order */
+struct TermResult
+{
+    String term;
+    Index<int> found;
+};
+
+struct BuildJob
+{
+    std::shared_ptr<Index<EntryInfo>> entries;
+    std::shared_ptr<Database> database;
+    int generation = 0;
+    std::atomic<bool> cancel {false};
+};
+
 static Playlist s_playlist;
 static Index<String> s_search_terms;
 
+/* kept up to date from the playlist update ranges; shared read-only with
+ * the build thread, so it is copied before writing if a build is running */
+static std::shared_ptr<Index<EntryInfo>> s_entries;
+static int s_generation;
+
 /* Note: added_table is accessed by multiple threads.
  * When adding = true, it may only be accessed by the playlist add thread.
  * When adding = false, it may only be accessed by the UI thread.
@@ -127,13 +215,23 @@ static Index<String> s_search_terms;
 static TinyLock s_adding_lock;
 static bool s_adding = false;
 static SimpleHash<String, bool> s_added_table;
+static bool s_sort_pending;
 
-static SimpleHash<Key, Item> s_database;
+static std::shared_ptr<Database> s_database;
 static bool s_database_valid;
+static std::shared_ptr<BuildJob> s_build_job;
+static std::thread s_build_thread;
+static QueuedFunc s_build_done;
 static Index<const Item *> s_items;
 static int s_hidden_items;
 static Index<bool> s_selection;
 
+/* kept from one search to the next, which usually has the same terms with
+ * one more character typed */
+static Index<TermResult> s_term_results;
+static Index<Range> s_ranges, s_term_ranges, s_ranges_tmp;
+static Index<char> s_mask;
+
 static QueuedFunc s_search_timer;
 static bool s_search_pending;
 
@@ -158,6 +256,7 @@ static void create_playlist ()
 {
     s_playlist = Playlist::blank_playlist ();
     s_playlist.set_title (_("Library"));
+    s_entries.reset ();
     s_playlist.active_playlist ();
 }
 
@@ -193,42 +292,125 @@ static String get_uri ()
     return to_uri (g_get_home_dir ());
 }
 
-static void destroy_database ()
+static void fill_entry (EntryInfo & info, int entry)
 {
-    s_items.clear ();
-    s_hidden_items = 0;
-    s_database.clear ();
-    s_database_valid = false;
+    Tuple tuple = s_playlist.entry_tuple (entry, Playlist::NoWait);
+
+    aud::array<SearchField, String> names;
+    names[SearchField::Genre] = tuple.get_str (Tuple::Genre);
+    names[SearchField::Artist] = tuple.get_str (Tuple::Artist);
+    names[SearchField::Album] = tuple.get_str (Tuple::Album);
+    names[SearchField::Title] = tuple.get_str (Tuple::Title);
+
+    info.filename = s_playlist.entry_filename (entry);
+
+    for (auto f : aud::range<SearchField> ())
+    {
+        if (names[f] == info.names[f])
+            continue;
+
+        info.names[f] = names[f];
+        info.folded[f] = names[f] ? String (str_tolower_utf8 (names[f])) : String ();
+    }
 }
 
-static void create_database ()
+static void reset_entries ()
 {
-    destroy_database ();
-
     int entries = s_playlist.n_entries ();
 
+    s_entries.reset (new Index<EntryInfo>);
+    s_entries->insert (0, entries);
+
     for (int e = 0; e < entries; e ++)
+        fill_entry ((* s_entries)[e], e);
+
+    s_generation ++;
+}
+
+/* copies the entry list first if a build in progress is still reading it */
+static Index<EntryInfo> & writable_entries ()
+{
+    if (s_entries.use_count () > 1)
     {
-        Tuple tuple = s_playlist.entry_tuple (e, Playlist::NoWait);
+        auto copy = std::make_shared<Index<EntryInfo>> ();
+        copy->insert (0, s_entries->len ());
+        std::copy (s_entries->begin (), s_entries->end (), copy->begin ());
+        s_entries = std::move (copy);
+    }
 
-        aud::array<SearchField, String> fields;
-        fields[SearchField::Genre] = tuple.get_str (Tuple::Genre);
-        fields[SearchField::Artist] = tuple.get_str (Tuple::Artist);
-        fields[SearchField::Album] = tuple.get_str (Tuple::Album);
-        fields[SearchField::Title] = tuple.get_str (Tuple::Title);
+    s_generation ++;
+    return * s_entries;
+}
+
+/* returns true if the search fields of any entry may have changed */
+static bool update_entries ()
+{
+    if (! s_entries)
+    {
+        reset_entries ();
+        return true;
+    }
+
+    auto update = s_playlist.update_detail ();
+    if (update.level < Playlist::Metadata)
+        return false;
+
+    int entries = s_playlist.n_entries ();
+    int changed = entries - update.before - update.after;
+    int removed = s_entries->len () - update.before - update.after;
+
+    if (changed < 0 || removed < 0)
+    {
+        reset_entries ();
+        return true;
+    }
+
+    Index<EntryInfo> & list = writable_entries ();
+
+    if (update.level == Playlist::Structure)
+    {
+        list.remove (update.before, removed);
+        list.insert (update.before, changed);
+    }
+    else if (removed != changed)
+    {
+        reset_entries ();
+        return true;
+    }
+
+    for (int e = update.before; e < update.before + changed; e ++)
+        fill_entry (list[e], e);
+
+    return true;
+}
+
+static void build_database (BuildJob & job, Database & database)
+{
+    const Index<EntryInfo> & entries = * job.entries;
+    int n_entries = entries.len ();
+
+    database.filenames.insert (0, n_entries);
+
+    for (int e = 0; e < n_entries; e ++)
+    {
+        if (! (e % BUILD_CHUNK) && job.cancel)
+            return;
+
+        const EntryInfo & info = entries[e];
+        database.filenames[e] = info.filename;
 
         Item * parent = nullptr;
-        SimpleHash<Key, Item> * hash = & s_database;
+        SimpleHash<Key, Item> * hash = & database.tree;
 
         for (auto f : aud::range<SearchField> ())
         {
-            if (fields[f])
+            if (info.names[f])
             {
-                Key key = {f, fields[f]};
+                Key key = {f, info.names[f]};
                 Item * item = hash->lookup (key);
 
                 if (! item)
-                    item = hash->add (key, Item (f, fields[f], parent));
+                    item = hash->add (key, Item (f, info.names[f], info.folded[f], parent));
 
                 item->matches.append (e);
 
@@ -241,34 +423,6 @@ static void create_database ()
             }
         }
     }
-
-    s_database_valid = true;
-}
-
-static void search_recurse (SimpleHash<Key, Item> & domain, int mask, Index<const Item *> & results)
-{
-    domain.iterate ([mask, & results] (const Key & key, Item & item)
-    {
-        int count = s_search_terms.len ();
-        int new_mask = mask;
-
-        for (int t = 0, bit = 1; t < count; t ++, bit <<= 1)
-        {
-            if (! (new_mask & bit))
-                continue; /* skip term if it is already found */
-
-            if (strstr (item.folded, s_search_terms[t]))
-                new_mask &= ~bit; /* we found it */
-            else if (! item.children.n_items ())
-                break; /* quit early if there are no children to search */
-        }
-
-        /* adding an item with exactly one child is redundant, so avoid it */
-        if (! new_mask && item.children.n_items () != 1)
-            results.append (& item);
-
-        search_recurse (item.children, new_mask, results);
-    });
 }
 
 static int item_compare (const Item * const & a, const Item * const & b)
@@ -298,6 +452,473 @@ static int item_compare_pass1 (const Item * const & a, const Item * const & b)
     return item_compare (a, b);
 }
 
+static void number_items (SimpleHash<Key, Item> & domain, Database & database)
+{
+    domain.iterate ([& database] (const Key & key, Item & item)
+    {
+        int i = database.items.len ();
+
+        database.items.append (& item);
+        database.subtree_end.append (0);
+
+        number_items (item.children, database);
+        database.subtree_end[i] = database.items.len ();
+    });
+}
+
+static unsigned make_gram (const unsigned char * s, int len, int pos)
+{
+    unsigned b1 = (pos + 1 < len) ? s[pos + 1] : GRAM_PAD;
+    unsigned b2 = (pos + 2 < len) ? s[pos + 2] : GRAM_PAD;
+    return s[pos] << 16 | b1 << 8 | b2;
+}
+
+static void add_posting (Database & database, int item, int & prev)
+{
+    unsigned delta = item - prev;
+
+    for (; delta >= 0x80; delta >>= 7)
+        database.postings.append (delta | 0x80);
+
+    database.postings.append (delta);
+    prev = item;
+}
+
+/* The pairs of trigram and item number are sorted to make the posting lists.
+ * Rather than all at once, this is done in passes over the trigrams starting
+ * with a range of bytes, so that only about GRAM_PASS_SIZE pairs are held at
+ * a time. */
+static void index_grams (BuildJob & job, Database & database)
+{
+    int n_items = database.items.len ();
+    int64_t first_bytes[256] {};
+
+    for (int i = 0; i < n_items; i ++)
+    {
+        if (! (i % BUILD_CHUNK) && job.cancel)
+            return;
+
+        const String & folded = database.items[i]->folded;
+        int len = strlen (folded);
+
+        for (int pos = 0; pos < len; pos ++)
+            first_bytes[(unsigned char) folded[pos]] ++;
+
+        database.name_start.append (database.names.len ());
+        database.names.insert (folded, -1, len + 1);
+    }
+
+    Index<uint64_t> pairs;
+    int n_postings = 0, prev = 0;
+
+    for (int first = 0; first < 256;)
+    {
+        /* as many bytes as fit in one pass, but at least one */
+        int last = first + 1;
+        int64_t size = first_bytes[first];
+
+        while (last < 256 && size + first_bytes[last] <= GRAM_PASS_SIZE)
+            size += first_bytes[last ++];
+
+        if (job.cancel)
+            return;
+
+        pairs.insert (0, (int) size);
+        int n_pairs = 0;
+
+        for (int i = 0; i < n_items; i ++)
+        {
+            auto name = (const unsigned char *) & database.names[database.name_start[i]];
+            int len = strlen ((const char *) name);
+
+            for (int pos = 0; pos < len; pos ++)
+            {
+                if (name[pos] >= first && name[pos] < last)
+                    pairs[n_pairs ++] = (uint64_t) make_gram (name, len, pos) << 32 | i;
+            }
+        }
+
+        std::sort (pairs.begin (), pairs.end ());
+
+        uint64_t prev_pair = (uint64_t) -1;
+
+        for (uint64_t pair : pairs)
+        {
+            if (pair == prev_pair)
+                continue; /* trigram occurs twice in the same name */
+
+            unsigned gram = pair >> 32;
+
+            if (! database.grams.len () || gram != database.grams[database.grams.len () - 1])
+            {
+                database.grams.append (gram);
+                database.gram_start.append (n_postings);
+                database.gram_offset.append (database.postings.len ());
+                prev = 0;
+            }
+
+            add_posting (database, (int) pair, prev);
+            n_postings ++;
+            prev_pair = pair;
+        }
+
+        pairs.remove (0, -1);
+        first = last;
+    }
+
+    database.gram_start.append (n_postings);
+    database.gram_offset.append (database.postings.len ());
+}
+
+static void rank_items (BuildJob & job, Database & database)
+{
+    int n_items = database.items.len ();
+
+    database.listable_before.insert (0, n_items + 1);
+
+    for (int i = 0; i < n_items; i ++)
+    {
+        /* listing an item with exactly one child is redundant, so avoid it */
+        bool listable = (database.items[i]->children.n_items () != 1);
+
+        database.listable_before[i + 1] = database.listable_before[i] + listable;
+
+        if (listable)
+            database.ranked.append (i);
+    }
+
+    if (job.cancel)
+        return;
+
+    std::sort (database.ranked.begin (), database.ranked.end (), [& database] (int a, int b)
+        { return item_compare_pass1 (database.items[a], database.items[b]) < 0; });
+}
+
+static void stop_build ()
+{
+    if (s_build_job)
+        s_build_job->cancel = true;
+
+    if (s_build_thread.joinable ())
+        s_build_thread.join ();
+
+    s_build_job.reset ();
+    s_build_done.stop ();
+}
+
+static void build_done (void * = nullptr);
+
+static void start_build ()
+{
+    /* a running build is restarted when it finishes */
+    if (s_build_job)
+        return;
+
+    auto job = std::make_shared<BuildJob> ();
+    job->entries = s_entries;
+    job->generation = s_generation;
+
+    s_build_job = job;
+
+    s_build_thread = std::thread ([job] ()
+    {
+        auto database = std::make_shared<Database> ();
+        build_database (* job, * database);
+        number_items (database->tree, * database);
+        index_grams (* job, * database);
+        rank_items (* job, * database);
+
+        if (job->cancel)
+            return;
+
+        job->entries.reset ();
+        job->database = std::move (database);
+        s_build_done.queue (build_done, nullptr);
+    });
+}
+
+static void destroy_database ()
+{
+    stop_build ();
+
+    s_items.clear ();
+    s_hidden_items = 0;
+    s_term_results.clear ();
+    s_database.reset ();
+    s_database_valid = false;
+}
+
+static int find_gram (const Database & db, unsigned gram)
+{
+    auto end = db.grams.end ();
+    auto it = std::lower_bound (db.grams.begin (), end, gram);
+    return it - db.grams.begin ();
+}
+
+static const char * folded_name (const Database & db, int i)
+{
+    return & db.names[db.name_start[i]];
+}
+
+/* number of items in the posting lists of a range of trigrams */
+static int count_postings (const Database & db, const Range & grams)
+{
+    return db.gram_start[grams.end] - db.gram_start[grams.start];
+}
+
+/* calls func for each item in the posting lists of a range of trigrams, in
+ * ascending order within each list */
+template<class F>
+static void decode_postings (const Database & db, const Range & grams, F func)
+{
+    const unsigned char * p = db.postings.begin () + db.gram_offset[grams.start];
+
+    for (int g = grams.start; g < grams.end; g ++)
+    {
+        const unsigned char * end = db.postings.begin () + db.gram_offset[g + 1];
+        int item = 0;
+
+        while (p < end)
+        {
+            unsigned delta = 0;
+
+            for (int shift = 0; ; shift += 7)
+            {
+                delta |= (* p & 0x7f) << shift;
+                if (! (* p ++ & 0x80))
+                    break;
+            }
+
+            item += delta;
+            func (item);
+        }
+    }
+}
+
+/* keeps the candidates that also appear in the posting list of a trigram;
+ * both are in ascending order */
+static void intersect_postings (const Database & db, const Range & gram, Index<int> & found)
+{
+    int kept = 0, i = 0;
+
+    decode_postings (db, gram, [& found, & kept, & i] (int item)
+    {
+        while (i < found.len () && found[i] < item)
+            i ++;
+
+        if (i < found.len () && found[i] == item)
+            found[kept ++] = found[i ++];
+    });
+
+    found.remove (kept, -1);
+}
+
+/* lists the items whose own folded name contains the term */
+static void find_term (const Database & db, const String & term,
+ const Index<TermResult> & previous, Index<int> & found)
+{
+    auto t = (const unsigned char *) (const char *) term;
+    int len = strlen (term);
+    Index<Range> lists;
+
+    if (len < 3)
+    {
+        /* every trigram starting with the term */
+        unsigned first = (len == 1) ? t[0] << 16 : (t[0] << 16 | t[1] << 8);
+        unsigned last = first + ((len == 1) ? 0x10000 : 0x100);
+
+        lists.append (find_gram (db, first), find_gram (db, last));
+    }
+    else
+    {
+        /* candidates are the items containing all trigrams of the term */
+        for (int pos = 0; pos + 3 <= len; pos ++)
+        {
+            unsigned gram = make_gram (t, len, pos);
+            int g = find_gram (db, gram);
+
+            if (g == db.grams.len () || db.grams[g] != gram)
+                return; /* no matches at all */
+
+            lists.append (g, g + 1);
+        }
+
+        std::sort (lists.begin (), lists.end (), [& db] (const Range & a, const Range & b)
+            { return count_postings (db, a) < count_postings (db, b); });
+    }
+
+    /* if the term extends one searched for last time, checking the items
+     * found for that one may be cheaper than going through the index */
+    const TermResult * narrow = nullptr;
+    int cost = count_postings (db, lists[0]);
+
+    for (const TermResult & prev : previous)
+    {
+        if (prev.found.len () < cost && (int) strlen (prev.term) < len &&
+         strstr (term, prev.term))
+        {
+            narrow = & prev;
+            cost = prev.found.len ();
+        }
+    }
+
+    if (narrow)
+    {
+        for (int i : narrow->found)
+        {
+            if (strstr (folded_name (db, i), term))
+                found.append (i);
+        }
+
+        return;
+    }
+
+    if (len < 3)
+    {
+        /* the trigrams are sorted by name, so the items come out of order */
+        int n_items = db.items.len ();
+
+        if (cost < n_items / 8)
+        {
+            decode_postings (db, lists[0], [& found] (int i) { found.append (i); });
+            std::sort (found.begin (), found.end ());
+            found.remove (std::unique (found.begin (), found.end ()) - found.begin (), -1);
+        }
+        else
+        {
+            if (s_mask.len () != n_items)
+            {
+                s_mask.clear ();
+                s_mask.insert (0, n_items);
+            }
+
+            decode_postings (db, lists[0], [] (int i) { s_mask[i] = true; });
+
+            for (int i = 0; i < n_items; i ++)
+            {
+                if (s_mask[i])
+                {
+                    found.append (i);
+                    s_mask[i] = false;
+                }
+            }
+        }
+
+        return;
+    }
+
+    decode_postings (db, lists[0], [& found] (int i) { found.append (i); });
+
+    /* once few candidates are left, checking their names below is cheaper
+     * than decoding the longer lists */
+    for (int l = 1; l < lists.len () && found.len (); l ++)
+    {
+        if (count_postings (db, lists[l]) > found.len () * 16)
+            break;
+
+        intersect_postings (db, lists[l], found);
+    }
+
+    /* a three-byte term is a trigram itself; longer ones may have their
+     * trigrams in a different order, or not all of them were checked */
+    if (len > 3)
+    {
+        int kept = 0;
+
+        for (int i : found)
+        {
+            if (strstr (folded_name (db, i), term))
+                found[kept ++] = i;
+        }
+
+        found.remove (kept, -1);
+    }
+}
+
+/* turns the found items into the ranges of their subtrees */
+static void expand_subtrees (const Database & db, const Index<int> & found, Index<Range> & ranges)
+{
+    ranges.remove (0, -1);
+
+    for (int i : found)
+    {
+        Range * last = ranges.len () ? & ranges[ranges.len () - 1] : nullptr;
+
+        if (last && i < last->end)
+            continue; /* inside the previous subtree */
+
+        if (last && i == last->end)
+            last->end = db.subtree_end[i];
+        else
+            ranges.append (i, db.subtree_end[i]);
+    }
+}
+
+static void intersect_ranges (const Index<Range> & a, const Index<Range> & b, Index<Range> & out)
+{
+    out.remove (0, -1);
+
+    for (int i = 0, j = 0; i < a.len () && j < b.len ();)
+    {
+        int start = aud::max (a[i].start, b[j].start);
+        int end = aud::min (a[i].end, b[j].end);
+
+        if (start < end)
+            out.append (start, end);
+
+        if (a[i].end < b[j].end)
+            i ++;
+        else
+            j ++;
+    }
+}
+
+static bool in_ranges (const Index<Range> & ranges, int i)
+{
+    auto it = std::upper_bound (ranges.begin (), ranges.end (), i,
+     [] (int item, const Range & range) { return item < range.start; });
+
+    return it != ranges.begin () && i < it[-1].end;
+}
+
+/* An item matches if every term is found in its own name or in the name
+ * of one of its parents, that is, if it lies in the subtree of an item
+ * found for each term.  The matching items are collected in s_ranges as
+ * ranges of item numbers, so only the candidates are ever visited. */
+static void search_database (const Database & db)
+{
+    Index<TermResult> results;
+
+    s_ranges.remove (0, -1);
+    s_ranges.append (0, db.items.len ());
+
+    for (const String & term : s_search_terms)
+    {
+        if (! term[0])
+            continue;
+
+        TermResult & result = results.append (term, Index<int> ());
+        const TermResult * same = nullptr;
+
+        for (const TermResult & prev : s_term_results)
+        {
+            if (prev.term == term)
+                same = & prev;
+        }
+
+        if (same)
+            result.found.insert (same->found.begin (), 0, same->found.len ());
+        else
+            find_term (db, term, s_term_results, result.found);
+
+        expand_subtrees (db, result.found, s_term_ranges);
+        intersect_ranges (s_ranges, s_term_ranges, s_ranges_tmp);
+        std::swap (s_ranges, s_ranges_tmp);
+    }
+
+    s_term_results = std::move (results);
+}
+
 static void do_search ()
 {
     s_items.clear ();
@@ -306,20 +927,63 @@ static void do_search ()
     if (! s_database_valid)
         return;
 
-    /* effectively limits number of search terms to 32 */
-    search_recurse (s_database, (1 << s_search_terms.len ()) - 1, s_items);
+    const Database & db = * s_database;
 
-    /* first sort by number of songs per item */
-    s_items.sort (item_compare_pass1);
+    search_database (db);
 
     int max_results = aud_get_int (CFG_ID, "max_results");
-    /* limit to items with most songs */
-    if (s_items.len () > max_results)
+    int total = 0;
+
+    for (const Range & range : s_ranges)
+        total += db.listable_before[range.end] - db.listable_before[range.start];
+
+    /* Walking the listed items best first finds the results after looking
+     * at about max_results * listable / total of them, each costing a binary
+     * search.  If most items match, a single pass over them is cheaper. */
+    if (total && (int64_t) max_results * db.ranked.len () * 8 < (int64_t) total * total)
+    {
+        for (int i : db.ranked)
+        {
+            if (s_items.len () >= max_results)
+                break;
+
+            if (in_ranges (s_ranges, i))
+                s_items.append (db.items[i]);
+        }
+    }
+    else
     {
-        s_hidden_items = s_items.len () - max_results;
-        s_items.remove (max_results, -1);
+        /* keep the items with most songs in a heap whose top is the one
+         * that would be dropped first */
+        auto better = [] (const Item * a, const Item * b)
+            { return item_compare_pass1 (a, b) < 0; };
+
+        for (const Range & range : s_ranges)
+        {
+            for (int i = range.start; i < range.end; i ++)
+            {
+                const Item * item = db.items[i];
+
+                if (item->children.n_items () == 1)
+                    continue; /* see rank_items() */
+
+                if (s_items.len () < max_results)
+                {
+                    s_items.append (item);
+                    std::push_heap (s_items.begin (), s_items.end (), better);
+                }
+                else if (max_results > 0 && better (item, s_items[0]))
+                {
+                    std::pop_heap (s_items.begin (), s_items.end (), better);
+                    s_items[max_results - 1] = item;
+                    std::push_heap (s_items.begin (), s_items.end (), better);
+                }
+            }
+        }
     }
 
+    s_hidden_items = total - s_items.len ();
+
     /* sort by item type, then item name */
     s_items.sort (item_compare);
 
@@ -348,11 +1012,135 @@ static bool filter_cb (const char * filename, void * unused)
     return add;
 }
 
+/* the watcher replaces a full rescan at startup once it has a journal */
+static bool watch_ready ()
+{
+    if (! aud_get_bool (CFG_ID, "watch") || ! check_playlist (false, false))
+        return false;
+
+    StringBuf path = uri_to_filename (get_uri ());
+    return path && watch_has_journal (path);
+}
+
+static void apply_watch_changes (void * = nullptr);
+static void begin_add (const char * uri);
+
+static void start_watch (bool rebuild)
+{
+    watch_stop ();
+
+    if (! aud_get_bool (CFG_ID, "watch") || ! check_playlist (false, false))
+        return;
+
+    /* only local folders can be watched */
+    String uri = get_uri ();
+    StringBuf path = uri_to_filename (uri);
+    if (! path)
+        return;
+
+    /* without a journal, nothing tells what changed since the playlist was
+     * last refreshed, so refresh it; the journal is recorded when done */
+    if (! rebuild && ! watch_has_journal (path))
+        begin_add (uri);
+    else
+        watch_start (path, rebuild, apply_watch_changes);
+}
+
+/* Brings the playlist in line with the folders the watcher found changed:
+ * entries in removed folders or missing from a changed folder are removed,
+ * modified files are rescanned and new files are added. */
+static void apply_watch_changes (void *)
+{
+    if (s_adding || ! check_playlist (true, false))
+        return; /* called again when adding is complete */
+
+    Index<WatchDir> changes = watch_take_changes ();
+    if (! changes.len ())
+        return;
+
+    SimpleHash<String, bool> dirs;          /* folder -> removed */
+    SimpleHash<String, WatchFile *> files;  /* not yet found in the playlist */
+    SimpleHash<String, bool> rescan;
+
+    for (WatchDir & dir : changes)
+    {
+        dirs.add (dir.uri, bool (dir.removed));
+
+        for (WatchFile & file : dir.files)
+            files.add (file.uri, & file);
+    }
+
+    int entries = s_playlist.n_entries ();
+
+    for (int entry = 0; entry < entries; entry ++)
+    {
+        String filename = s_playlist.entry_filename (entry);
+        const char * slash = strrchr (filename, '/');
+        bool * removed = nullptr;
+        bool remove = false;
+
+        if (slash)
+            removed = dirs.lookup (String (str_copy (filename, slash - filename)));
+
+        if (removed)
+        {
+            WatchFile * * file = files.lookup (filename);
+
+            if (* removed || ! file)
+                remove = true;
+            else
+            {
+                if ((* file)->modified)
+                    rescan.add (filename, true);
+
+                files.remove (filename);
+            }
+        }
+
+        s_playlist.select_entry (entry, remove);
+    }
+
+    s_playlist.remove_selected ();
+
+    if (rescan.n_items ())
+    {
+        entries = s_playlist.n_entries ();
+
+        for (int entry = 0; entry < entries; entry ++)
+        {
+            String filename = s_playlist.entry_filename (entry);
+            s_playlist.select_entry (entry, rescan.lookup (filename) != nullptr);
+        }
+
+        s_playlist.rescan_selected ();
+        s_playlist.select_all (false);
+    }
+
+    Index<PlaylistAddItem> add;
+
+    files.iterate ([& add] (const String & uri, WatchFile * & file)
+        { add.append (uri, Tuple (), file->decoder); });
+
+    if (add.len ())
+    {
+        s_sort_pending = true;
+        s_playlist.insert_items (-1, std::move (add), false);
+    }
+}
+
+static void watch_changed ()
+{
+    if (results_list)
+        start_watch (false);
+}
+
 static void begin_add (const char * uri)
 {
     if (s_adding)
         return;
 
+    watch_stop ();
+
     if (! check_playlist (false, false))
         create_playlist ();
 
@@ -443,12 +1231,35 @@ static void trigger_search ()
     s_search_pending = true;
 }
 
+static void build_done (void *)
+{
+    if (s_build_thread.joinable ())
+        s_build_thread.join ();
+
+    auto job = std::move (s_build_job);
+    if (! job || ! job->database)
+        return;
+
+    s_database = std::move (job->database);
+    s_database_valid = true;
+    s_term_results.clear ();
+
+    search_timeout ();
+    show_hide_widgets ();
+
+    /* the playlist changed while building */
+    if (job->generation != s_generation)
+        start_build ();
+}
+
 static void update_database ()
 {
     if (check_playlist (true, true))
     {
-        create_database ();
-        search_timeout ();
+        if (! s_entries)
+            reset_entries ();
+
+        start_build ();
     }
     else
     {
@@ -490,7 +1301,13 @@ static void add_complete_cb (void *, void *)
             s_playlist.select_all (false);
 
         s_playlist.sort_entries (Playlist::Path);
+        start_watch (true);
     }
+    else if (s_sort_pending)
+        s_playlist.sort_entries (Playlist::Path);
+
+    s_sort_pending = false;
+    apply_watch_changes ();
 
     if (! s_database_valid && ! s_playlist.update_pending ())
         update_database ();
@@ -507,19 +1324,27 @@ static void scan_complete_cb (void *, void *)
 
 static void playlist_update_cb (void *, void *)
 {
-    if (! s_database_valid || ! check_playlist (true, true) ||
-        s_playlist.update_detail ().level >= Playlist::Metadata)
+    if (! check_playlist (false, false))
     {
+        s_entries.reset ();
         update_database ();
+        return;
     }
+
+    bool changed = update_entries ();
+
+    if (! s_database_valid || ! check_playlist (true, true) || changed)
+        update_database ();
 }
 
 static void search_init ()
 {
     find_playlist ();
 
-    if (aud_get_bool (CFG_ID, "rescan_on_startup"))
+    if (aud_get_bool (CFG_ID, "rescan_on_startup") && ! watch_ready ())
         begin_add (get_uri ());
+    else
+        start_watch (false);
 
     update_database ();
 
@@ -534,6 +1359,9 @@ static void search_cleanup ()
     hook_dissociate ("playlist scan complete", scan_complete_cb);
     hook_dissociate ("playlist update", playlist_update_cb);
 
+    watch_stop ();
+    s_sort_pending = false;
+
     s_search_timer.stop ();
     s_search_pending = false;
 
@@ -547,6 +1375,14 @@ static void search_cleanup ()
 
     s_added_table.clear ();
     destroy_database ();
+    s_entries.reset ();
+}
+
+/* the database can lag behind the playlist while a new one is being built */
+static bool entry_current (int entry)
+{
+    return entry < s_playlist.n_entries () &&
+     s_playlist.entry_filename (entry) == s_database->filenames[entry];
 }
 
 static void do_add (bool play, bool set_title)
@@ -569,11 +1405,16 @@ static void do_add (bool play, bool set_title)
 
         for (int entry : item->matches)
         {
-            add.append (
-                s_playlist.entry_filename (entry),
-                s_playlist.entry_tuple (entry, Playlist::NoWait),
-                s_playlist.entry_decoder (entry, Playlist::NoWait)
-            );
+            if (entry_current (entry))
+            {
+                add.append (
+                    s_playlist.entry_filename (entry),
+                    s_playlist.entry_tuple (entry, Playlist::NoWait),
+                    s_playlist.entry_decoder (entry, Playlist::NoWait)
+                );
+            }
+            else
+                add.append (s_database->filenames[entry]);
         }
 
         n_selected ++;
@@ -715,10 +1556,11 @@ static Index<char> list_get_data (void * user)
             if (buf.len ())
                 buf.append ('\n');
 
-            String filename = s_playlist.entry_filename (entry);
+            const String & filename = s_database->filenames[entry];
             buf.insert (filename, -1, strlen (filename));
 
-            s_playlist.select_entry (entry, true);
+            if (entry_current (entry))
+                s_playlist.select_entry (entry, true);
         }
     }
 
@@ -0,0 +1,498 @@
+/*
+ * watch.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "watch.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+#include <atomic>
+#include <thread>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/mainloop.h>
+#include <libaudcore/multihash.h>
+#include <libaudcore/probe.h>
+#include <libaudcore/runtime.h>
+#include <libaudcore/tinylock.h>
+
+#define WATCH_DELAY 2000 /* ms without events before changed folders are listed */
+
+#ifdef __linux__
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+ IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#endif
+
+struct DirInfo
+{
+    int64_t mtime;   /* of the folder itself, when it was last listed */
+    int64_t checked; /* time it was last listed */
+    int wd;          /* inotify watch, or -1 */
+    bool dirty;      /* inotify reported a change */
+};
+
+/* The journal is only touched by the worker thread while it is running.
+ * Changes are handed over under s_lock. */
+static String s_root;
+static bool s_rebuild;
+static SimpleHash<String, DirInfo> s_dirs;
+static Index<String> s_wd_paths;
+
+static std::thread s_thread;
+static std::atomic<bool> s_stop;
+static int s_inotify = -1;
+static int s_wake[2] = {-1, -1};
+
+static TinyLock s_lock;
+static Index<WatchDir> s_changes;
+static QueuedFunc s_notify;
+static void (* s_changed) (void *);
+
+static StringBuf journal_path ()
+{
+    return filename_build ({aud_get_path (AudPath::UserDir), "search-tool-folders"});
+}
+
+/* Journal layout (text): the library folder on the first line, then one
+ * line per folder with its modification time, the time it was listed and
+ * its path. */
+
+static bool load_journal (const char * root)
+{
+    char * data;
+    if (! g_file_get_contents (journal_path (), & data, nullptr, nullptr))
+        return false;
+
+    char * next = strchr (data, '\n');
+    bool valid = (next && ! strncmp (data, root, next - data) && ! root[next - data]);
+
+    while (valid && next)
+    {
+        char * line = next + 1;
+        if ((next = strchr (line, '\n')))
+            * next = 0;
+
+        long long mtime, checked;
+        int pos = 0;
+
+        if (sscanf (line, "%lld %lld %n", & mtime, & checked, & pos) == 2 && pos && line[pos])
+            s_dirs.add (String (line + pos), {mtime, checked, -1, false});
+    }
+
+    g_free (data);
+    return valid && s_dirs.n_items ();
+}
+
+static void save_journal ()
+{
+    Index<char> data;
+    auto append = [& data] (const char * s)
+        { data.insert (s, -1, strlen (s)); };
+
+    append (s_root);
+    append ("\n");
+
+    s_dirs.iterate ([& append] (const String & path, DirInfo & info)
+    {
+        append (str_printf ("%lld %lld ", (long long) info.mtime, (long long) info.checked));
+        append (path);
+        append ("\n");
+    });
+
+    StringBuf path = journal_path ();
+    if (! g_file_set_contents (path, data.begin (), data.len (), nullptr))
+        AUDERR ("Failed to write %s\n", (const char *) path);
+}
+
+static void add_watch (const String & path, DirInfo & info)
+{
+#ifdef __linux__
+    if (s_inotify < 0 || info.wd >= 0)
+        return;
+
+    int wd = inotify_add_watch (s_inotify, path, WATCH_MASK);
+
+    if (wd < 0)
+    {
+        if (errno == ENOSPC)
+        {
+            AUDWARN ("Not enough inotify watches for the library folders; changes "
+             "will only be found at startup (see fs.inotify.max_user_watches).\n");
+
+            close (s_inotify);
+            s_inotify = -1;
+        }
+
+        return;
+    }
+
+    if (wd >= s_wd_paths.len ())
+        s_wd_paths.insert (-1, wd + 1 - s_wd_paths.len ());
+
+    s_wd_paths[wd] = path;
+    info.wd = wd;
+#endif
+}
+
+static void remove_watch (DirInfo & info)
+{
+#ifdef __linux__
+    if (info.wd < 0)
+        return;
+
+    if (s_inotify >= 0)
+        inotify_rm_watch (s_inotify, info.wd);
+
+    s_wd_paths[info.wd] = String ();
+    info.wd = -1;
+#endif
+}
+
+/* Lists a folder, queueing subfolders not in the journal yet.  If changes
+ * are wanted, the playable files are added to them, flagged as modified if
+ * they were written since the folder was last listed. */
+static void list_dir (const String & path, DirInfo & info, Index<String> & new_dirs,
+ Index<WatchDir> * changes)
+{
+    GDir * dir = g_dir_open (path, 0, nullptr);
+    if (! dir)
+        return;
+
+    int64_t checked = info.checked;
+    info.checked = time (nullptr);
+
+    WatchDir * change = nullptr;
+    if (changes)
+        change = & changes->append (String (filename_to_uri (path)), false);
+
+    const char * name;
+    while ((name = g_dir_read_name (dir)))
+    {
+        if (name[0] == '.')
+            continue;
+
+        StringBuf child = filename_build ({path, name});
+
+        GStatBuf st;
+        if (g_stat (child, & st) < 0)
+            continue;
+
+        if (S_ISDIR (st.st_mode))
+        {
+            String child_path (child);
+            if (! s_dirs.lookup (child_path))
+                new_dirs.append (std::move (child_path));
+        }
+        else if (change && S_ISREG (st.st_mode))
+        {
+            String uri (filename_to_uri (child));
+            VFSFile file;
+
+            PluginHandle * decoder = aud_file_find_decoder (uri, true, file);
+            if (decoder)
+                change->files.append (std::move (uri), decoder, st.st_mtime >= checked);
+        }
+    }
+
+    g_dir_close (dir);
+}
+
+/* adds new folders and everything below them to the journal */
+static void add_dirs (Index<String> & queue, Index<WatchDir> * changes)
+{
+    for (int i = 0; i < queue.len () && ! s_stop; i ++)
+    {
+        String path = queue[i]; /* the queue grows while listing */
+
+        GStatBuf st;
+        if (strchr (path, '\n') || g_stat (path, & st) < 0 || ! S_ISDIR (st.st_mode))
+            continue;
+
+        DirInfo * info = s_dirs.add (path, {st.st_mtime, 0, -1, false});
+        add_watch (path, * info);
+        list_dir (path, * info, queue, changes);
+    }
+
+    queue.clear ();
+}
+
+/* drops a folder that is gone, along with its subfolders */
+static void remove_dirs (const String & path, Index<WatchDir> & changes)
+{
+    StringBuf prefix = str_concat ({path, G_DIR_SEPARATOR_S});
+    Index<String> gone;
+
+    s_dirs.iterate ([& path, & prefix, & gone] (const String & dir, DirInfo &)
+    {
+        if (dir == path || g_str_has_prefix (dir, prefix))
+            gone.append (dir);
+    });
+
+    for (const String & dir : gone)
+    {
+        remove_watch (* s_dirs.lookup (dir));
+        s_dirs.remove (dir);
+        changes.append (String (filename_to_uri (dir)), true);
+    }
+}
+
+/* Compares the folders in the journal (all of them, or those inotify has
+ * reported) with the file system, listing only the ones that changed.  A
+ * folder modified within the second it was listed is listed again, since
+ * the times have a resolution of one second. */
+static void check_dirs (bool all, Index<WatchDir> & changes)
+{
+    Index<String> paths, new_dirs;
+
+    s_dirs.iterate ([all, & paths] (const String & path, DirInfo & info)
+    {
+        if (all || info.dirty)
+            paths.append (path);
+    });
+
+    for (const String & path : paths)
+    {
+        if (s_stop)
+            break;
+
+        DirInfo * info = s_dirs.lookup (path);
+        if (! info)
+            continue; /* removed along with its parent */
+
+        bool dirty = info->dirty;
+        info->dirty = false;
+
+        add_watch (path, * info);
+
+        GStatBuf st;
+        if (g_stat (path, & st) < 0 || ! S_ISDIR (st.st_mode))
+        {
+            remove_dirs (path, changes);
+            continue;
+        }
+
+        if (st.st_mtime == info->mtime && st.st_mtime < info->checked && ! dirty)
+            continue;
+
+        info->mtime = st.st_mtime;
+        list_dir (path, * info, new_dirs, & changes);
+    }
+
+    add_dirs (new_dirs, & changes);
+}
+
+static void publish (Index<WatchDir> & changes)
+{
+    if (! changes.len ())
+        return;
+
+    tiny_lock (& s_lock);
+    s_changes.move_from (changes, 0, -1, -1, true, true);
+    tiny_unlock (& s_lock);
+
+    s_notify.queue (s_changed, nullptr);
+}
+
+#ifdef __linux__
+static void read_events (bool & check_all)
+{
+    alignas (inotify_event) char buf[4096];
+
+    ssize_t len;
+    while ((len = read (s_inotify, buf, sizeof buf)) > 0)
+    {
+        for (char * p = buf; p < buf + len; )
+        {
+            auto event = (const inotify_event *) p;
+            p += sizeof (inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                check_all = true;
+                continue;
+            }
+
+            if (event->wd < 0 || event->wd >= s_wd_paths.len () || ! s_wd_paths[event->wd])
+                continue;
+
+            DirInfo * info = s_dirs.lookup (s_wd_paths[event->wd]);
+
+            if (event->mask & IN_IGNORED)
+            {
+                /* the folder is gone; check_dirs() will notice */
+                s_wd_paths[event->wd] = String ();
+                if (info)
+                    info->wd = -1;
+            }
+
+            if (info)
+                info->dirty = true;
+        }
+    }
+}
+#endif
+
+static void watch_main ()
+{
+    Index<WatchDir> changes;
+    Index<String> queue;
+
+    if (s_rebuild || ! load_journal (s_root))
+    {
+        /* if the journal was lost, every folder may have changed */
+        s_dirs.clear ();
+        queue.append (s_root);
+        add_dirs (queue, s_rebuild ? nullptr : & changes);
+    }
+    else
+        check_dirs (true, changes);
+
+    if (s_stop)
+        return;
+
+    save_journal ();
+    publish (changes);
+
+#ifdef __linux__
+    bool pending = false, check_all = false;
+
+    while (s_inotify >= 0 && s_wake[0] >= 0)
+    {
+        pollfd fds[2] = {{s_wake[0], POLLIN, 0}, {s_inotify, POLLIN, 0}};
+
+        /* wait until no events have come in for a while */
+        int ready = poll (fds, 2, pending ? WATCH_DELAY : -1);
+
+        if (s_stop)
+            break;
+
+        if (ready > 0)
+        {
+            read_events (check_all);
+            pending = true;
+        }
+        else if (! ready && pending)
+        {
+            check_dirs (check_all, changes);
+
+            if (s_stop)
+                break;
+
+            save_journal ();
+            publish (changes);
+
+            pending = check_all = false;
+        }
+    }
+#endif
+}
+
+bool watch_has_journal (const char * path)
+{
+    bool found = false;
+    FILE * handle = g_fopen (journal_path (), "r");
+
+    if (handle)
+    {
+        int len = strlen (path);
+        StringBuf line (len + 1);
+
+        found = (fread (line, 1, len + 1, handle) == (size_t) len + 1 &&
+         ! strncmp (line, path, len) && line[len] == '\n');
+
+        fclose (handle);
+    }
+
+    return found;
+}
+
+void watch_start (const char * path, bool rebuild, void (* changed) (void *))
+{
+    watch_stop ();
+
+    s_root = String (path);
+    s_rebuild = rebuild;
+    s_changed = changed;
+    s_stop = false;
+
+#ifdef __linux__
+    if ((s_inotify = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC)) < 0)
+        AUDWARN ("inotify_init1 failed: %s\n", strerror (errno));
+
+    if (pipe (s_wake) < 0)
+        s_wake[0] = s_wake[1] = -1;
+#endif
+
+    s_thread = std::thread (watch_main);
+}
+
+void watch_stop ()
+{
+    if (! s_thread.joinable ())
+        return;
+
+    s_stop = true;
+
+#ifdef __linux__
+    if (s_wake[1] >= 0 && write (s_wake[1], "", 1) < 0)
+        AUDWARN ("Failed to stop watching the library folders.\n");
+#endif
+
+    s_thread.join ();
+
+#ifdef __linux__
+    for (int fd : {s_inotify, s_wake[0], s_wake[1]})
+    {
+        if (fd >= 0)
+            close (fd);
+    }
+
+    s_inotify = s_wake[0] = s_wake[1] = -1;
+#endif
+
+    s_notify.stop ();
+    s_dirs.clear ();
+    s_wd_paths.clear ();
+    s_root = String ();
+
+    tiny_lock (& s_lock);
+    s_changes.clear ();
+    tiny_unlock (& s_lock);
+}
+
+Index<WatchDir> watch_take_changes ()
+{
+    tiny_lock (& s_lock);
+    Index<WatchDir> changes = std::move (s_changes);
+    tiny_unlock (& s_lock);
+
+    return changes;
+}
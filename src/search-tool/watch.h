@@ -0,0 +1,56 @@
+/*
+ * watch.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef SEARCH_TOOL_WATCH_H
+#define SEARCH_TOOL_WATCH_H
+
+#include <libaudcore/index.h>
+#include <libaudcore/objects.h>
+
+class PluginHandle;
+
+/* a playable file found in a folder whose contents changed */
+struct WatchFile
+{
+    String uri;
+    PluginHandle * decoder;
+    bool modified; /* written since the folder was last listed */
+};
+
+/* a folder whose contents changed; files missing from the list are gone */
+struct WatchDir
+{
+    String uri;
+    bool removed;
+    Index<WatchFile> files;
+};
+
+/* Keeps a journal of the modification times of all folders under a local
+ * library folder, so that only the folders that changed since the last run
+ * need to be listed again, and (on Linux) watches them with inotify while
+ * running.  Changes are collected on a worker thread; changed() is called
+ * on the main thread when there are any to take.  With rebuild = true, the
+ * journal is recorded anew from the current state of the folders; without
+ * it, a missing or unreadable journal reports every folder as changed. */
+bool watch_has_journal (const char * path);
+void watch_start (const char * path, bool rebuild, void (* changed) (void *));
+void watch_stop ();
+Index<WatchDir> watch_take_changes ();
+
+#endif
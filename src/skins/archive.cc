@@ -0,0 +1,312 @@
+/*
+ * archive.cc
+ * Copyright 2026 Audacious developers
+ *
+ * This file is part of Audacious.
+ *
+ * Audacious is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2 or version 3 of the License.
+ *
+ * Audacious is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audacious. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Audacious team does not consider modular code linking to Audacious or
+ * using our public API to be a derived work.
+ */
+
+#include "archive.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
+
+/* skins are a few hundred kilobytes; anything much bigger is not a skin */
+#define MAX_MEMBER_SIZE (64 << 20)
+
+#define ZIP_LOCAL_HEADER 0x04034b50
+#define ZIP_CENTRAL_HEADER 0x02014b50
+#define ZIP_END_HEADER 0x06054b50
+
+#define ZIP_LOCAL_SIZE 30
+#define ZIP_CENTRAL_SIZE 46
+#define ZIP_END_SIZE 22
+
+#define TAR_BLOCK 512
+
+static unsigned get16 (const char * p)
+{
+    auto u = (const unsigned char *) p;
+    return u[0] | (u[1] << 8);
+}
+
+static uint32_t get32 (const char * p)
+{
+    auto u = (const unsigned char *) p;
+    return u[0] | (u[1] << 8) | (u[2] << 16) | ((uint32_t) u[3] << 24);
+}
+
+/* strips the folders from a member's path; archives made on Windows may
+ * use backslashes */
+static StringBuf member_name (const char * path, int len)
+{
+    const char * end = path + len;
+    const char * base = path;
+
+    for (const char * c = path; c < end; c ++)
+    {
+        if (* c == '/' || * c == '\\')
+            base = c + 1;
+    }
+
+    return str_copy (base, end - base);
+}
+
+static bool zip_inflate (const char * in, int64_t in_len, char * out, int64_t out_len)
+{
+    z_stream stream {};
+
+    /* negative window bits: raw deflate data without a zlib header */
+    if (inflateInit2 (& stream, -MAX_WBITS) != Z_OK)
+        return false;
+
+    stream.next_in = (Bytef *) in;
+    stream.avail_in = in_len;
+    stream.next_out = (Bytef *) out;
+    stream.avail_out = out_len;
+
+    int ret = inflate (& stream, Z_FINISH);
+    inflateEnd (& stream);
+
+    return ret == Z_STREAM_END && ! stream.avail_out;
+}
+
+bool zip_read (const Index<char> & archive, ArchiveFilter filter,
+ Index<ArchiveMember> & members)
+{
+    const char * data = archive.begin ();
+    int64_t len = archive.len ();
+
+    /* the end of central directory record is followed only by a comment
+     * of up to 64 KiB */
+    int64_t end = len - ZIP_END_SIZE;
+    int64_t min_end = aud::max (end - 0xffff, (int64_t) 0);
+
+    while (end >= min_end && get32 (data + end) != ZIP_END_HEADER)
+        end --;
+
+    if (end < min_end)
+    {
+        AUDERR ("Not a ZIP file.\n");
+        return false;
+    }
+
+    int count = get16 (data + end + 10);
+    int64_t pos = get32 (data + end + 16);
+
+    for (int i = 0; i < count; i ++)
+    {
+        if (pos + ZIP_CENTRAL_SIZE > len || get32 (data + pos) != ZIP_CENTRAL_HEADER)
+        {
+            AUDERR ("Corrupt ZIP file.\n");
+            return false;
+        }
+
+        const char * entry = data + pos;
+        unsigned flags = get16 (entry + 8);
+        unsigned method = get16 (entry + 10);
+        int64_t packed = get32 (entry + 20);
+        int64_t size = get32 (entry + 24);
+        int name_len = get16 (entry + 28);
+        int64_t local = get32 (entry + 42);
+
+        pos += ZIP_CENTRAL_SIZE + name_len + get16 (entry + 30) + get16 (entry + 32);
+
+        if (pos > len)
+        {
+            AUDERR ("Corrupt ZIP file.\n");
+            return false;
+        }
+
+        StringBuf name = member_name (entry + ZIP_CENTRAL_SIZE, name_len);
+        if (! name[0] || (filter && ! filter (name)))
+            continue;
+
+        if (local + ZIP_LOCAL_SIZE > len || get32 (data + local) != ZIP_LOCAL_HEADER)
+        {
+            AUDERR ("Corrupt ZIP file.\n");
+            return false;
+        }
+
+        int64_t start = local + ZIP_LOCAL_SIZE + get16 (data + local + 26) +
+         get16 (data + local + 28);
+
+        if (start + packed > len || size > MAX_MEMBER_SIZE)
+        {
+            AUDERR ("Corrupt ZIP file.\n");
+            return false;
+        }
+
+        if ((flags & 1) || (method != 0 && method != 8))
+        {
+            AUDWARN ("Skipping %s: unsupported compression.\n", (const char *) name);
+            continue;
+        }
+
+        Index<char> contents;
+        contents.insert (0, size);
+
+        bool ok;
+        if (method == 0)
+        {
+            ok = (packed == size);
+            if (ok)
+                memcpy (contents.begin (), data + start, size);
+        }
+        else
+            ok = zip_inflate (data + start, packed, contents.begin (), size);
+
+        if (! ok)
+        {
+            AUDWARN ("Skipping %s: corrupt data.\n", (const char *) name);
+            continue;
+        }
+
+        members.append (String (name), std::move (contents));
+    }
+
+    return true;
+}
+
+/* numeric fields are octal, terminated by a space or null */
+static int64_t tar_number (const char * field, int len)
+{
+    int64_t value = 0;
+
+    for (int i = 0; i < len && field[i] >= '0' && field[i] <= '7'; i ++)
+        value = (value << 3) | (field[i] - '0');
+
+    return value;
+}
+
+static bool tar_check_header (const char * header)
+{
+    /* the checksum is taken with the checksum field itself set to spaces */
+    int64_t sum = 8 * ' ';
+
+    for (int i = 0; i < TAR_BLOCK; i ++)
+    {
+        if (i < 148 || i >= 156)
+            sum += (unsigned char) header[i];
+    }
+
+    return sum == tar_number (header + 148 + strspn (header + 148, " "), 8);
+}
+
+bool tar_read (const Index<char> & archive, ArchiveFilter filter,
+ Index<ArchiveMember> & members)
+{
+    const char * data = archive.begin ();
+    int64_t len = archive.len ();
+    int64_t pos = 0;
+
+    String long_name;
+
+    /* the archive ends with a block of zeroes */
+    while (pos + TAR_BLOCK <= len && data[pos])
+    {
+        const char * header = data + pos;
+
+        if (! tar_check_header (header))
+        {
+            AUDERR ("Corrupt tar file.\n");
+            return false;
+        }
+
+        int64_t size = tar_number (header + 124, 12);
+        int64_t start = pos + TAR_BLOCK;
+
+        if (start + size > len || size > MAX_MEMBER_SIZE)
+        {
+            AUDERR ("Corrupt tar file.\n");
+            return false;
+        }
+
+        pos = start + (size + TAR_BLOCK - 1) / TAR_BLOCK * TAR_BLOCK;
+
+        char type = header[156];
+
+        /* GNU tar stores paths longer than 100 characters in an extra
+         * member placed before the file */
+        if (type == 'L')
+        {
+            long_name = String (str_copy (data + start, strnlen (data + start, size)));
+            continue;
+        }
+
+        StringBuf name = long_name ?
+         member_name (long_name, strlen (long_name)) :
+         member_name (header, strnlen (header, 100));
+
+        long_name = String ();
+
+        /* regular files only */
+        if (type != '0' && type != '\0' && type != '7')
+            continue;
+        if (! name[0] || (filter && ! filter (name)))
+            continue;
+
+        Index<char> contents;
+        contents.insert (data + start, 0, size);
+        members.append (String (name), std::move (contents));
+    }
+
+    return true;
+}
+
+bool gzip_inflate (const Index<char> & in, Index<char> & out)
+{
+    z_stream stream {};
+
+    /* 16 + window bits: gzip header and trailer */
+    if (inflateInit2 (& stream, 16 + MAX_WBITS) != Z_OK)
+        return false;
+
+    stream.next_in = (Bytef *) in.begin ();
+    stream.avail_in = in.len ();
+
+    out.clear ();
+    int ret = Z_OK;
+
+    while (ret == Z_OK && out.len () < MAX_MEMBER_SIZE)
+    {
+        int done = stream.total_out;
+
+        /* grow the buffer geometrically */
+        out.insert (-1, aud::max (done, 65536));
+
+        stream.next_out = (Bytef *) out.begin () + done;
+        stream.avail_out = out.len () - done;
+
+        ret = inflate (& stream, Z_NO_FLUSH);
+        out.remove (stream.total_out, -1);
+    }
+
+    inflateEnd (& stream);
+
+    if (ret != Z_STREAM_END)
+    {
+        AUDERR ("Corrupt gzip file.\n");
+        out.clear ();
+        return false;
+    }
+
+    return true;
+}
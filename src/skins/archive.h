@@ -0,0 +1,49 @@
+/*
+ * archive.h
+ * Copyright 2026 Audacious developers
+ *
+ * This file is part of Audacious.
+ *
+ * Audacious is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, version 2 or version 3 of the License.
+ *
+ * Audacious is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+ * A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * Audacious. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * The Audacious team does not consider modular code linking to Audacious or
+ * using our public API to be a derived work.
+ */
+
+#ifndef SKINS_ARCHIVE_H
+#define SKINS_ARCHIVE_H
+
+#include <libaudcore/index.h>
+#include <libaudcore/objects.h>
+
+/* A regular file read out of an archive.  Folders inside the archive are
+ * not kept, so the name is only the last component of the member's path
+ * (as with "unzip -j"). */
+struct ArchiveMember {
+    String name;
+    Index<char> data;
+};
+
+/* Called with the name of each member before it is decompressed; members
+ * for which it returns false are skipped. */
+typedef bool (* ArchiveFilter) (const char * name);
+
+/* These read the whole archive, which is already in memory. */
+bool zip_read (const Index<char> & archive, ArchiveFilter filter,
+ Index<ArchiveMember> & members);
+bool tar_read (const Index<char> & archive, ArchiveFilter filter,
+ Index<ArchiveMember> & members);
+
+/* Decompresses a gzip stream, as found in a .tar.gz file. */
+bool gzip_inflate (const Index<char> & in, Index<char> & out);
+
+#endif /* SKINS_ARCHIVE_H */
@@ -130,13 +130,67 @@ void PlaylistWidget::cancel_all ()
     popup_hide ();
 }
 
+PangoLayout * PlaylistWidget::get_layout (const char * text, int width, LayoutMode mode)
+{
+    LayoutKey key = {String (text ? text : ""), width, mode};
+
+    PangoLayoutPtr * layout = m_layouts[m_cur_layouts].lookup (key);
+    if (layout)
+        return layout->get ();
+
+    PangoLayoutPtr * prev = m_layouts[m_cur_layouts ^ 1].lookup (key);
+    if (prev && prev->get ())
+        return m_layouts[m_cur_layouts].add (key, std::move (* prev))->get ();
+
+    PangoLayout * created = gtk_widget_create_pango_layout (gtk_dr (), text);
+    pango_layout_set_font_description (created, m_font.get ());
+
+    if (mode != LayoutPlain)
+        pango_layout_set_width (created, PANGO_SCALE * width);
+
+    if (mode == LayoutTitle)
+        pango_layout_set_ellipsize (created, PANGO_ELLIPSIZE_END);
+    else if (mode == LayoutHeader)
+    {
+        pango_layout_set_alignment (created, PANGO_ALIGN_CENTER);
+        pango_layout_set_ellipsize (created, PANGO_ELLIPSIZE_MIDDLE);
+    }
+
+    return m_layouts[m_cur_layouts].add (key, PangoLayoutPtr (created))->get ();
+}
+
+void PlaylistWidget::clear_layouts ()
+{
+    m_layouts[0].clear ();
+    m_layouts[1].clear ();
+}
+
 void PlaylistWidget::draw (cairo_t * cr)
 {
+    int64_t start_time = g_get_monotonic_time ();
+
     int active_entry = m_playlist.get_position ();
     int left = 3, right = 3;
     PangoLayout * layout;
     int width;
 
+    /* fetch each visible entry once */
+
+    int visible = aud::max (aud::min (m_rows, m_length - m_first), 0);
+    Index<String> titles, lengths;
+    titles.insert (0, visible);
+    lengths.insert (0, visible);
+
+    for (int i = 0; i < visible; i ++)
+    {
+        Tuple tuple = m_playlist.entry_tuple (m_first + i, Playlist::NoWait);
+        int len = tuple.get_int (Tuple::Length);
+
+        titles[i] = tuple.get_str (Tuple::FormattedTitle);
+        if (len >= 0)
+            lengths[i] = String (str_format_time (len));
+    }
+
     /* background */
 
     set_cairo_color (cr, skin.colors[SKIN_PLEDIT_NORMALBG]);
@@ -146,16 +200,11 @@ void PlaylistWidget::draw (cairo_t * cr)
 
     if (m_offset)
     {
-        layout = gtk_widget_create_pango_layout (gtk_dr (), m_title_text);
-        pango_layout_set_font_description (layout, m_font.get ());
-        pango_layout_set_width (layout, PANGO_SCALE * (m_width - left - right));
-        pango_layout_set_alignment (layout, PANGO_ALIGN_CENTER);
-        pango_layout_set_ellipsize (layout, PANGO_ELLIPSIZE_MIDDLE);
+        layout = get_layout (m_title_text, m_width - left - right, LayoutHeader);
 
         cairo_move_to (cr, left, 0);
         set_cairo_color (cr, skin.colors[SKIN_PLEDIT_NORMAL]);
         pango_cairo_show_layout (cr, layout);
-        g_object_unref (layout);
     }
 
     /* selection highlight */
@@ -181,8 +230,7 @@ void PlaylistWidget::draw (cairo_t * cr)
             char buf[16];
             snprintf (buf, sizeof buf, "%d.", 1 + i);
 
-            layout = gtk_widget_create_pango_layout (gtk_dr (), buf);
-            pango_layout_set_font_description (layout, m_font.get ());
+            layout = get_layout (buf, 0, LayoutPlain);
 
             PangoRectangle rect;
             pango_layout_get_pixel_extents (layout, nullptr, & rect);
@@ -192,7 +240,6 @@ void PlaylistWidget::draw (cairo_t * cr)
             set_cairo_color (cr, skin.colors[(i == active_entry) ?
              SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
             pango_cairo_show_layout (cr, layout);
-            g_object_unref (layout);
         }
 
         left += width + 4;
@@ -202,15 +249,13 @@ void PlaylistWidget::draw (cairo_t * cr)
 
     width = 0;
 
-    for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
+    for (int i = m_first; i < m_first + visible; i ++)
     {
-        Tuple tuple = m_playlist.entry_tuple (i, Playlist::NoWait);
-        int len = tuple.get_int (Tuple::Length);
-        if (len < 0)
+        const String & len = lengths[i - m_first];
+        if (! len)
             continue;
 
-        layout = gtk_widget_create_pango_layout (gtk_dr (), str_format_time (len));
-        pango_layout_set_font_description (layout, m_font.get ());
+        layout = get_layout (len, 0, LayoutPlain);
 
         PangoRectangle rect;
         pango_layout_get_pixel_extents (layout, nullptr, & rect);
@@ -220,7 +265,6 @@ void PlaylistWidget::draw (cairo_t * cr)
         set_cairo_color (cr, skin.colors[(i == active_entry) ?
          SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
         pango_cairo_show_layout (cr, layout);
-        g_object_unref (layout);
     }
 
     right += width + 6;
@@ -240,8 +284,7 @@ void PlaylistWidget::draw (cairo_t * cr)
             char buf[16];
             snprintf (buf, sizeof buf, "(#%d)", 1 + pos);
 
-            layout = gtk_widget_create_pango_layout (gtk_dr (), buf);
-            pango_layout_set_font_description (layout, m_font.get ());
+            layout = get_layout (buf, 0, LayoutPlain);
 
             PangoRectangle rect;
             pango_layout_get_pixel_extents (layout, nullptr, & rect);
@@ -252,7 +295,6 @@ void PlaylistWidget::draw (cairo_t * cr)
             set_cairo_color (cr, skin.colors[(i == active_entry) ?
              SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
             pango_cairo_show_layout (cr, layout);
-            g_object_unref (layout);
         }
 
         right += width + 6;
@@ -260,21 +302,14 @@ void PlaylistWidget::draw (cairo_t * cr)
 
     /* titles */
 
-    for (int i = m_first; i < m_first + m_rows && i < m_length; i ++)
+    for (int i = m_first; i < m_first + visible; i ++)
     {
-        Tuple tuple = m_playlist.entry_tuple (i, Playlist::NoWait);
-        String title = tuple.get_str (Tuple::FormattedTitle);
-
-        layout = gtk_widget_create_pango_layout (gtk_dr (), title);
-        pango_layout_set_font_description (layout, m_font.get ());
-        pango_layout_set_width (layout, PANGO_SCALE * (m_width - left - right));
-        pango_layout_set_ellipsize (layout, PANGO_ELLIPSIZE_END);
+        layout = get_layout (titles[i - m_first], m_width - left - right, LayoutTitle);
 
         cairo_move_to (cr, left, m_offset + m_row_height * (i - m_first));
         set_cairo_color (cr, skin.colors[(i == active_entry) ?
          SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
         pango_cairo_show_layout (cr, layout);
-        g_object_unref (layout);
     }
 
     /* focus rectangle */
@@ -304,6 +339,12 @@ void PlaylistWidget::draw (cairo_t * cr)
         set_cairo_color (cr, skin.colors[SKIN_PLEDIT_NORMAL]);
         cairo_stroke (cr);
     }
+
+    /* layouts not used in this frame are dropped at the end of the next one */
+    m_cur_layouts ^= 1;
+    m_layouts[m_cur_layouts].clear ();
+
+    AUDDBG ("Playlist frame took %d us.\n", (int) (g_get_monotonic_time () - start_time));
 }
 
 PlaylistWidget::PlaylistWidget (int width, int height, const char * font) :
@@ -326,6 +367,7 @@ void PlaylistWidget::resize (int width, int height)
 void PlaylistWidget::set_font (const char * font)
 {
     m_font.capture (pango_font_description_from_string (font));
+    clear_layouts ();
 
     PangoLayout * layout = gtk_widget_create_pango_layout (gtk_dr (), "A");
     pango_layout_set_font_description (layout, m_font.get ());
@@ -30,6 +30,7 @@
 
 #include <libaudcore/hook.h>
 #include <libaudcore/mainloop.h>
+#include <libaudcore/multihash.h>
 #include <libaudcore/playlist.h>
 
 #include "widget.h"
@@ -38,6 +39,11 @@ class PlaylistSlider;
 
 typedef SmartPtr<PangoFontDescription, pango_font_description_free> PangoFontDescPtr;
 
+static inline void unref_layout (PangoLayout * layout)
+    { g_object_unref (layout); }
+
+typedef SmartPtr<PangoLayout, unref_layout> PangoLayoutPtr;
+
 class PlaylistWidget : public Widget
 {
 public:
@@ -56,6 +62,26 @@ public:
     int hover_end ();
 
 private:
+    enum LayoutMode {
+        LayoutPlain,     /* natural width */
+        LayoutTitle,     /* fixed width, ellipsized at the end */
+        LayoutHeader     /* fixed width, centered, ellipsized in the middle */
+    };
+
+    struct LayoutKey {
+        String text;
+        int width;
+        LayoutMode mode;
+
+        bool operator== (const LayoutKey & b) const
+            { return text == b.text && width == b.width && mode == b.mode; }
+        unsigned hash () const
+            { return text.hash () + width * 31 + mode; }
+    };
+
+    PangoLayout * get_layout (const char * text, int width, LayoutMode mode);
+    void clear_layouts ();
+
     void draw (cairo_t * cr);
     bool button_press (GdkEventButton * event);
     bool button_release (GdkEventButton * event);
@@ -89,6 +115,12 @@ private:
     PangoFontDescPtr m_font;
     String m_title_text;
 
+    /* Layouts used in the current and the previous frame.  Layouts still
+     * needed are carried over from the previous frame, so that scrolling only
+     * lays out the newly exposed rows. */
+    SimpleHash<LayoutKey, PangoLayoutPtr> m_layouts[2];
+    int m_cur_layouts = 0;
+
     Playlist m_playlist;
     int m_length = 0;
     int m_width = 0, m_height = 0, m_row_height = 1, m_offset = 0, m_rows = 0, m_first = 0;
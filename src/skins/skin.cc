@@ -93,18 +93,17 @@ static const uint32_t default_vis_colors[24] = {
 
 Skin skin;
 
-static bool skin_load_pixmap_id (SkinPixmapId id, const char * path)
+static bool skin_load_pixmap_id (SkinPixmapId id, const SkinFiles & files)
 {
-    StringBuf filename = skin_pixmap_locate (path, skin_pixmap_id_map[id].name,
-     skin_pixmap_id_map[id].alt_name);
-
-    if (! filename)
+    Index<char> data;
+    if (! files.read_pixmap (skin_pixmap_id_map[id].name,
+     skin_pixmap_id_map[id].alt_name, data))
     {
         AUDERR ("Skin does not contain a \"%s\" pixmap.\n", skin_pixmap_id_map[id].name);
         return false;
     }
 
-    skin.pixmaps[id].capture (surface_new_from_file (filename));
+    skin.pixmaps[id].capture (surface_new_from_data (data, skin_pixmap_id_map[id].name));
     return skin.pixmaps[id] ? true : false;
 }
 
@@ -149,15 +148,14 @@ static void skin_get_eq_spline_colors (cairo_surface_t * s)
         skin.eq_spline_colors[i] = surface_get_pixel (s, 115, i + 294);
 }
 
-static void skin_load_viscolor (const char * path)
+static void skin_load_viscolor (const SkinFiles & files)
 {
     memcpy (skin.vis_colors, default_vis_colors, sizeof skin.vis_colors);
 
-    VFSFile file = open_local_file_nocase (path, "viscolor.txt");
-    if (! file)
+    Index<char> buffer;
+    if (! files.read ("viscolor.txt", buffer))
         return;
 
-    Index<char> buffer = file.read_all ();
     buffer.append (0);  /* null-terminated */
 
     char * string = buffer.begin ();
@@ -190,13 +188,11 @@ static void skin_numbers_generate_dash (CairoSurfacePtr & s)
     s.capture (surface);
 }
 
-static bool skin_load_pixmaps (const char * path)
+static bool skin_load_pixmaps (const SkinFiles & files)
 {
-    AUDDBG ("Loading pixmaps in %s\n", path);
-
     /* eq_ex.bmp was added after Winamp 2.0 so some skins do not include it */
     for (int i = 0; i < SKIN_PIXMAP_COUNT; i ++)
-        if (! skin_load_pixmap_id ((SkinPixmapId) i, path) && i != SKIN_EQ_EX)
+        if (! skin_load_pixmap_id ((SkinPixmapId) i, files) && i != SKIN_EQ_EX)
             return false;
 
     skin_get_textcolors (skin.pixmaps[SKIN_TEXT].get ());
@@ -213,36 +209,25 @@ static bool skin_load_data (const char * path)
     if (! g_file_test (path, G_FILE_TEST_EXISTS))
         return false;
 
-    StringBuf archive_path;
-    if (file_is_archive (path))
+    SkinFiles files;
+    if (! files.open (path))
     {
-        AUDDBG ("Attempt to load archive\n");
-        archive_path = archive_decompress (path);
-
-        if (! archive_path)
-        {
-            AUDDBG ("Unable to extract skin archive (%s)\n", path);
-            return false;
-        }
-
-        path = archive_path;
+        AUDDBG ("Unable to read skin (%s)\n", path);
+        return false;
     }
 
-    bool success = skin_load_pixmaps (path);
+    bool success = skin_load_pixmaps (files);
 
     if (success)
     {
-        skin_load_hints (path);
-        skin_load_pl_colors (path);
-        skin_load_viscolor (path);
-        skin_load_masks (path);
+        skin_load_hints (files);
+        skin_load_pl_colors (files);
+        skin_load_viscolor (files);
+        skin_load_masks (files);
     }
     else
         AUDDBG ("Skin loading failed\n");
 
-    if (archive_path)
-        del_directory (archive_path);
-
     return success;
 }
 
@@ -24,6 +24,7 @@
  */
 
 #include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -46,57 +47,6 @@
 #define DIRMODE (S_IRWXU)
 #endif
 
-StringBuf find_file_case_path (const char * folder, const char * basename)
-{
-    static SimpleHash<String, Index<String>> cache;
-
-    String key (folder);
-    Index<String> * list = cache.lookup (key);
-
-    if (! list)
-    {
-        GDir * handle = g_dir_open (folder, 0, nullptr);
-        if (! handle)
-            return StringBuf ();
-
-        list = cache.add (key, Index<String> ());
-
-        const char * name;
-        while ((name = g_dir_read_name (handle)))
-            list->append (name);
-
-        g_dir_close (handle);
-    }
-
-    for (const String & entry : * list)
-    {
-        if (! strcmp_nocase (entry, basename))
-            return filename_build ({folder, entry});
-    }
-
-    return StringBuf ();
-}
-
-VFSFile open_local_file_nocase (const char * folder, const char * basename)
-{
-    StringBuf path = find_file_case_path (folder, basename);
-    return path ? VFSFile (path, "r") : VFSFile ();
-}
-
-StringBuf skin_pixmap_locate (const char * folder, const char * basename, const char * altname)
-{
-    static const char * const exts[] = {".bmp", ".png", ".xpm"};
-
-    for (const char * ext : exts)
-    {
-        StringBuf name = find_file_case_path (folder, str_concat ({basename, ext}));
-        if (name)
-            return name.settle ();
-    }
-
-    return altname ? skin_pixmap_locate (folder, altname) : StringBuf ();
-}
-
 char * text_parse_line (char * text)
 {
     char * newline = strchr (text, '\n');
@@ -116,8 +66,6 @@ enum ArchiveType {
     ARCHIVE_TBZ2
 };
 
-typedef StringBuf (* ArchiveExtractFunc) (const char *, const char *);
-
 struct ArchiveExtensionType {
     ArchiveType type;
     const char *ext;
@@ -133,69 +81,6 @@ static ArchiveExtensionType archive_extensions[] = {
     {ARCHIVE_TBZ2, ".bz2"}
 };
 
-static StringBuf archive_extract_tar (const char * archive, const char * dest);
-static StringBuf archive_extract_zip (const char * archive, const char * dest);
-static StringBuf archive_extract_tgz (const char * archive, const char * dest);
-static StringBuf archive_extract_tbz2 (const char * archive, const char * dest);
-
-static ArchiveExtractFunc archive_extract_funcs[] = {
-    nullptr,
-    archive_extract_tar,
-    archive_extract_tgz,
-    archive_extract_zip,
-    archive_extract_tbz2
-};
-
-/* FIXME: these functions can be generalised into a function using a
- * command lookup table */
-
-static const char * get_tar_command ()
-{
-    static const char * command = nullptr;
-
-    if (! command)
-    {
-        if (! (command = getenv("TARCMD")))
-            command = "tar";
-    }
-
-    return command;
-}
-
-static const char * get_unzip_command ()
-{
-    static const char * command = nullptr;
-
-    if (! command)
-    {
-        if (! (command = getenv("UNZIPCMD")))
-            command = "unzip";
-    }
-
-    return command;
-}
-
-static StringBuf archive_extract_tar (const char * archive, const char * dest)
-{
-    return str_printf ("%s >/dev/null xf \"%s\" -C %s", get_tar_command (), archive, dest);
-}
-
-static StringBuf archive_extract_zip (const char * archive, const char * dest)
-{
-    return str_printf ("%s >/dev/null -o -j \"%s\" -d %s", get_unzip_command (), archive, dest);
-}
-
-static StringBuf archive_extract_tgz (const char * archive, const char * dest)
-{
-    return str_printf ("%s >/dev/null xzf \"%s\" -C %s", get_tar_command (), archive, dest);
-}
-
-static StringBuf archive_extract_tbz2 (const char * archive, const char * dest)
-{
-    return str_printf ("bzip2 -dc \"%s\" | %s >/dev/null xf - -C %s", archive,
-     get_tar_command (), dest);
-}
-
 static ArchiveType archive_get_type (const char * filename)
 {
     for (auto & ext : archive_extensions)
@@ -253,49 +138,171 @@ static StringBuf escape_shell_chars (const char * string)
     return escaped;
 }
 
+/* There is no bzip2 decoder in-process, so a .tar.bz2 file is
+ * decompressed by the bzip2 program into memory and the tar data is then
+ * read as usual. */
+static Index<char> read_bzip2 (const char * filename)
+{
+    Index<char> data;
+
+    StringBuf cmd = str_printf ("bzip2 -dc \"%s\" 2>/dev/null",
+     (const char *) escape_shell_chars (filename));
+
+    FILE * pipe = popen (cmd, "r");
+    if (! pipe)
+    {
+        AUDWARN ("Error executing \"%s\": %s\n", (const char *) cmd, strerror (errno));
+        return data;
+    }
+
+    int64_t done;
+    do
+    {
+        int pos = data.len ();
+        data.insert (-1, 65536);
+        done = fread (& data[pos], 1, 65536, pipe);
+        data.remove (pos + done, -1);
+    }
+    while (done > 0);
+
+    int ret = pclose (pipe);
+    if (ret != 0)
+    {
+        AUDDBG ("Command \"%s\" returned error %d\n", (const char *) cmd, ret);
+        data.clear ();
+    }
+
+    return data;
+}
+
 /**
- * Decompresses the archive "filename" to a temporary directory,
- * returns the path to the temp dir, or nullptr if failed
+ * Reads the members of the archive "filename" that pass "filter" into
+ * memory.  Returns false if the archive could not be read.
  */
-StringBuf archive_decompress (const char * filename)
+bool archive_read (const char * filename, ArchiveFilter filter,
+ Index<ArchiveMember> & members)
 {
     ArchiveType type = archive_get_type (filename);
     if (type == ARCHIVE_UNKNOWN)
-        return StringBuf ();
+        return false;
+
+    Index<char> data;
 
-    StringBuf tmpdir = filename_build ({g_get_tmp_dir (), "audacious.XXXXXX"});
-    if (! g_mkdtemp (tmpdir))
+    if (type == ARCHIVE_TBZ2)
+        data = read_bzip2 (filename);
+    else
     {
-        AUDWARN ("Error creating %s: %s\n", (const char *) tmpdir, strerror (errno));
-        return StringBuf ();
+        VFSFile file (filename, "r");
+        if (file)
+            data = file.read_all ();
     }
 
-    StringBuf escaped_filename = escape_shell_chars (filename);
-    StringBuf cmd = archive_extract_funcs[type] (escaped_filename, tmpdir);
+    if (! data.len ())
+        return false;
 
-    AUDDBG ("Executing \"%s\"\n", (const char *) cmd);
-    int ret = system (cmd);
-    if (ret != 0)
+    if (type == ARCHIVE_TGZ)
     {
-        AUDDBG ("Command \"%s\" returned error %d\n", (const char *) cmd, ret);
-        return StringBuf ();
+        Index<char> tar;
+        if (! gzip_inflate (data, tar))
+            return false;
+
+        data = std::move (tar);
     }
 
-    return tmpdir;
+    if (type == ARCHIVE_ZIP)
+        return zip_read (data, filter, members);
+    else
+        return tar_read (data, filter, members);
 }
 
-static void del_directory_func (const char * path, const char *)
+bool SkinFiles::open (const char * path, ArchiveFilter filter)
 {
-    if (g_file_test (path, G_FILE_TEST_IS_DIR))
-        del_directory (path);
-    else
-        g_unlink (path);
+    m_paths.clear ();
+    m_members.clear ();
+
+    if (file_is_archive (path))
+    {
+        Index<ArchiveMember> members;
+        if (! archive_read (path, filter, members))
+            return false;
+
+        for (ArchiveMember & member : members)
+            m_members.add (String (str_tolower (member.name)), std::move (member.data));
+
+        return true;
+    }
+
+    GDir * dir = g_dir_open (path, 0, nullptr);
+    if (! dir)
+        return false;
+
+    const char * name;
+    while ((name = g_dir_read_name (dir)))
+    {
+        if (! filter || filter (name))
+            m_paths.add (String (str_tolower (name)), String (filename_build ({path, name})));
+    }
+
+    g_dir_close (dir);
+    return true;
+}
+
+bool SkinFiles::read (const char * name, Index<char> & data) const
+{
+    String key (str_tolower (name));
+    data.clear ();
+
+    auto contents = m_members.lookup (key);
+    if (contents)
+    {
+        data.insert (contents->begin (), 0, contents->len ());
+        return true;
+    }
+
+    auto path = m_paths.lookup (key);
+    if (! path)
+        return false;
+
+    VFSFile file (* path, "r");
+    if (! file)
+        return false;
+
+    data = file.read_all ();
+    return true;
 }
 
-void del_directory (const char * path)
+bool SkinFiles::read_pixmap (const char * name, const char * altname,
+ Index<char> & data) const
 {
-    dir_foreach (path, del_directory_func);
-    g_rmdir (path);
+    static const char * const exts[] = {".bmp", ".png", ".xpm"};
+
+    for (const char * ext : exts)
+    {
+        if (read (str_concat ({name, ext}), data))
+            return true;
+    }
+
+    return altname ? read_pixmap (altname, nullptr, data) : false;
+}
+
+VFSFile SkinFiles::open_file (const char * name) const
+{
+    String key (str_tolower (name));
+
+    auto path = m_paths.lookup (key);
+    if (path)
+        return VFSFile (* path, "r");
+
+    auto contents = m_members.lookup (key);
+    if (! contents)
+        return VFSFile ();
+
+    VFSFile file = VFSFile::tmpfile ();
+    if (! file || file.fwrite (contents->begin (), 1, contents->len ()) !=
+     contents->len () || file.fseek (0, VFS_SEEK_SET) < 0)
+        return VFSFile ();
+
+    return file;
 }
 
 Index<int> string_to_int_array (const char * str)
@@ -26,20 +26,38 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <libaudcore/multihash.h>
 #include <libaudcore/vfs.h>
 
+#include "archive.h"
+
 typedef void (* DirForeachFunc) (const char * path, const char * basename);
 
-StringBuf find_file_case_path (const char * folder, const char * basename);
+/* The files of a skin, which is either a folder or an archive.  An archive
+ * is read into memory when it is opened, so nothing is extracted to disk.
+ * Files are looked up by name, ignoring case.  The filter, if given,
+ * limits which files are kept. */
+class SkinFiles
+{
+public:
+    bool open (const char * path, ArchiveFilter filter = nullptr);
+
+    bool read (const char * name, Index<char> & data) const;
+    /* tries the .bmp, .png and .xpm extensions, then the same for altname */
+    bool read_pixmap (const char * name, const char * altname,
+     Index<char> & data) const;
+
+    /* an archive member is copied into a temporary file */
+    VFSFile open_file (const char * name) const;
 
-VFSFile open_local_file_nocase (const char * folder, const char * basename);
-StringBuf skin_pixmap_locate (const char * folder, const char * basename,
- const char * altname = nullptr);
+private:
+    SimpleHash<String, String> m_paths;            /* folder */
+    SimpleHash<String, Index<char>> m_members;     /* archive */
+};
 
 char * text_parse_line (char * text);
 
 void make_directory (const char * path);
-void del_directory (const char * path);
 
 bool dir_foreach (const char * path, DirForeachFunc func);
 
@@ -47,6 +65,7 @@ Index<int> string_to_int_array (const char *str);
 
 bool file_is_archive (const char * filename);
 StringBuf archive_basename (const char * str);
-StringBuf archive_decompress (const char * path);
+bool archive_read (const char * filename, ArchiveFilter filter,
+ Index<ArchiveMember> & members);
 
 #endif
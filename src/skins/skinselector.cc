@@ -24,8 +24,13 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 #include <libaudcore/audstrings.h>
 #include <libaudcore/i18n.h>
+#include <libaudcore/mainloop.h>
 #include <libaudcore/runtime.h>
 #include <libaudgui/libaudgui-gtk.h>
 
@@ -33,8 +38,13 @@
 #include "skin.h"
 #include "skinselector.h"
 #include "skins_util.h"
+#include "surface.h"
 #include "view.h"
 
+/* previews missing from the thumbnail cache are made by a few worker
+ * threads, so that the list is shown before they are all done */
+#define PREVIEW_THREADS 4
+
 enum SkinViewCols {
     SKIN_VIEW_COL_PREVIEW,
     SKIN_VIEW_COL_FORMATTEDNAME,
@@ -46,62 +56,147 @@ struct SkinNode {
     String name, desc, path;
 };
 
+struct PreviewResult {
+    int row;
+    AudguiPixbuf thumb;
+};
+
 static Index<SkinNode> skinlist;
 
-static void skin_view_on_cursor_changed (GtkTreeView * treeview);
+static GtkTreeView * preview_view;
+static Index<int> preview_rows;  /* rows of skinlist still lacking a preview */
+static int preview_size;
+static std::atomic<int> preview_next;
+static std::atomic<bool> preview_quit;
+static std::thread preview_threads[PREVIEW_THREADS];
 
-static AudguiPixbuf skin_get_preview (const char * path)
-{
-    AudguiPixbuf preview;
+static std::mutex preview_mutex;
+static Index<PreviewResult> preview_results;
+static QueuedFunc preview_done;
 
-    StringBuf archive_path;
-    if (file_is_archive (path))
-    {
-        archive_path = archive_decompress (path);
-        if (! archive_path)
-            return preview;
+static void skin_view_on_cursor_changed (GtkTreeView * treeview);
 
-        path = archive_path;
-    }
+static bool is_main_pixmap (const char * name)
+{
+    return str_has_prefix_nocase (name, "main.");
+}
 
-    StringBuf preview_path = skin_pixmap_locate (path, "main");
-    if (preview_path)
-        preview.capture (gdk_pixbuf_new_from_file (preview_path, nullptr));
+/* called from the worker threads */
+static AudguiPixbuf skin_get_preview (const char * path)
+{
+    SkinFiles files;
+    Index<char> data;
 
-    if (archive_path)
-        del_directory (archive_path);
+    /* only main.bmp is needed, so nothing else is decompressed */
+    if (! files.open (path, is_main_pixmap) || ! files.read_pixmap ("main", nullptr, data))
+        return AudguiPixbuf ();
 
-    return preview;
+    return pixbuf_new_from_data (data, "main");
 }
 
-static AudguiPixbuf skin_get_thumbnail (const char * path)
+static StringBuf skin_get_thumbnail_path (const char * path)
 {
     StringBuf base = filename_get_base (path);
     base.insert (-1, ".png");
 
-    StringBuf thumbname = filename_build ({skins_get_skin_thumb_dir (), base});
+    return filename_build ({skins_get_skin_thumb_dir (), base});
+}
+
+static AudguiPixbuf skin_get_cached_thumbnail (const char * path)
+{
+    StringBuf thumbname = skin_get_thumbnail_path (path);
     AudguiPixbuf thumb;
 
     if (g_file_test (thumbname, G_FILE_TEST_EXISTS))
         thumb.capture (gdk_pixbuf_new_from_file (thumbname, nullptr));
 
-    if (! thumb)
-    {
-        thumb = skin_get_preview (path);
+    if (thumb)
+        audgui_pixbuf_scale_within (thumb, preview_size);
 
-        if (thumb)
-        {
-            make_directory (skins_get_skin_thumb_dir ());
-            gdk_pixbuf_save (thumb.get (), thumbname, "png", nullptr, nullptr);
-        }
-    }
+    return thumb;
+}
+
+/* called from the worker threads */
+static AudguiPixbuf skin_make_thumbnail (const char * path, const char * thumbname)
+{
+    AudguiPixbuf thumb = skin_get_preview (path);
 
     if (thumb)
-        audgui_pixbuf_scale_within (thumb, audgui_get_dpi () * 3 / 2);
+    {
+        gdk_pixbuf_save (thumb.get (), thumbname, "png", nullptr, nullptr);
+        audgui_pixbuf_scale_within (thumb, preview_size);
+    }
 
     return thumb;
 }
 
+static void preview_add (void *)
+{
+    preview_mutex.lock ();
+    Index<PreviewResult> results = std::move (preview_results);
+    preview_mutex.unlock ();
+
+    auto model = gtk_tree_view_get_model (preview_view);
+
+    for (PreviewResult & result : results)
+    {
+        GtkTreeIter iter;
+        if (gtk_tree_model_iter_nth_child (model, & iter, nullptr, result.row))
+            gtk_list_store_set ((GtkListStore *) model, & iter,
+             SKIN_VIEW_COL_PREVIEW, result.thumb.get (), -1);
+    }
+}
+
+static void preview_worker ()
+{
+    int i;
+    while (! preview_quit && (i = preview_next ++) < preview_rows.len ())
+    {
+        const String & path = skinlist[preview_rows[i]].path;
+        AudguiPixbuf thumb = skin_make_thumbnail (path, skin_get_thumbnail_path (path));
+
+        if (! thumb)
+            continue;
+
+        preview_mutex.lock ();
+        preview_results.append (preview_rows[i], std::move (thumb));
+        preview_mutex.unlock ();
+
+        preview_done.queue (preview_add, nullptr);
+    }
+}
+
+static void preview_start (GtkTreeView * treeview)
+{
+    preview_view = treeview;
+    preview_next = 0;
+
+    /* create the folder here rather than in each thread */
+    make_directory (skins_get_skin_thumb_dir ());
+
+    int n_threads = aud::min (preview_rows.len (), PREVIEW_THREADS);
+    for (int i = 0; i < n_threads; i ++)
+        preview_threads[i] = std::thread (preview_worker);
+}
+
+static void preview_stop ()
+{
+    preview_quit = true;
+
+    for (std::thread & thread : preview_threads)
+    {
+        if (thread.joinable ())
+            thread.join ();
+    }
+
+    preview_quit = false;
+    preview_done.stop ();
+
+    preview_rows.clear ();
+    preview_results.clear ();
+    preview_view = nullptr;
+}
+
 static void scan_skindir_func (const char * path, const char * basename)
 {
     if (g_file_test (path, G_FILE_TEST_IS_REGULAR))
@@ -141,17 +236,25 @@ void skin_view_update (GtkTreeView * treeview)
 {
     g_signal_handlers_block_by_func (treeview, (void *) skin_view_on_cursor_changed, nullptr);
 
+    /* the workers read skinlist */
+    preview_stop ();
+
     auto store = (GtkListStore *) gtk_tree_view_get_model (treeview);
     gtk_list_store_clear (store);
 
     skinlist_update ();
+    preview_size = audgui_get_dpi () * 3 / 2;
 
     String current_path = aud_get_str ("skins", "skin");
     GtkTreePath * current_skin = nullptr;
 
-    for (const SkinNode & node : skinlist)
+    for (int row = 0; row < skinlist.len (); row ++)
     {
-        AudguiPixbuf thumbnail = skin_get_thumbnail (node.path);
+        const SkinNode & node = skinlist[row];
+        AudguiPixbuf thumbnail = skin_get_cached_thumbnail (node.path);
+        if (! thumbnail)
+            preview_rows.append (row);
+
         StringBuf formattedname = str_concat ({"<big><b>", node.name,
          "</b></big>\n<i>", node.desc, "</i>"});
 
@@ -174,6 +277,9 @@ void skin_view_update (GtkTreeView * treeview)
         gtk_tree_path_free (current_skin);
     }
 
+    if (preview_rows.len ())
+        preview_start (treeview);
+
     g_signal_handlers_unblock_by_func (treeview, (void *) skin_view_on_cursor_changed, nullptr);
 }
 
@@ -227,4 +333,5 @@ void skin_view_realize (GtkTreeView * treeview)
 
     g_signal_connect (treeview, "cursor-changed",
      (GCallback) skin_view_on_cursor_changed, nullptr);
+    g_signal_connect (treeview, "destroy", (GCallback) preview_stop, nullptr);
 }
@@ -31,28 +31,49 @@ cairo_surface_t * surface_new (int w, int h)
     return cairo_image_surface_create (CAIRO_FORMAT_RGB24, w, h);
 }
 
-cairo_surface_t * surface_new_from_file (const char * name)
+static cairo_surface_t * surface_new_from_pixbuf (GdkPixbuf * p)
 {
+    cairo_surface_t * surface = surface_new (gdk_pixbuf_get_width (p),
+     gdk_pixbuf_get_height (p));
+    cairo_t * cr = cairo_create (surface);
+
+    gdk_cairo_set_source_pixbuf (cr, p, 0, 0);
+    cairo_paint (cr);
+
+    cairo_destroy (cr);
+    return surface;
+}
+
+AudguiPixbuf pixbuf_new_from_data (const Index<char> & data, const char * name)
+{
+    GdkPixbufLoader * loader = gdk_pixbuf_loader_new ();
     GError * error = nullptr;
-    AudguiPixbuf p (gdk_pixbuf_new_from_file (name, & error));
+    AudguiPixbuf p;
 
-    if (error)
+    if (gdk_pixbuf_loader_write (loader, (const unsigned char *) data.begin (),
+     data.len (), & error) && gdk_pixbuf_loader_close (loader, & error))
+    {
+        GdkPixbuf * pb = gdk_pixbuf_loader_get_pixbuf (loader);
+        if (pb)
+            p = AudguiPixbuf ((GdkPixbuf *) g_object_ref (pb));
+    }
+    else
     {
         AUDERR ("Error loading %s: %s.\n", name, error->message);
         g_error_free (error);
-    }
-
-    if (! p)
-        return nullptr;
 
-    cairo_surface_t * surface = surface_new (p.width (), p.height ());
-    cairo_t * cr = cairo_create (surface);
+        /* close it anyway; the error has already been reported */
+        gdk_pixbuf_loader_close (loader, nullptr);
+    }
 
-    gdk_cairo_set_source_pixbuf (cr, p.get (), 0, 0);
-    cairo_paint (cr);
+    g_object_unref (loader);
+    return p;
+}
 
-    cairo_destroy (cr);
-    return surface;
+cairo_surface_t * surface_new_from_data (const Index<char> & data, const char * name)
+{
+    AudguiPixbuf p = pixbuf_new_from_data (data, name);
+    return p ? surface_new_from_pixbuf (p.get ()) : nullptr;
 }
 
 uint32_t surface_get_pixel (cairo_surface_t * s, int x, int y)
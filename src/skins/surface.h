@@ -25,8 +25,13 @@
 #include <stdint.h>
 #include <cairo.h>
 
+#include <libaudcore/index.h>
+#include <libaudgui/libaudgui-gtk.h>
+
 cairo_surface_t * surface_new (int w, int h);
-cairo_surface_t * surface_new_from_file (const char * name);
+/* decodes an image read into memory; name is only used in messages */
+cairo_surface_t * surface_new_from_data (const Index<char> & data, const char * name);
+AudguiPixbuf pixbuf_new_from_data (const Index<char> & data, const char * name);
 uint32_t surface_get_pixel (cairo_surface_t * s, int x, int y);
 void surface_copy_rect (cairo_surface_t * a, int ax, int ay, int w, int h,
  cairo_surface_t * b, int bx, int by);
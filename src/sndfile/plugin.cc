@@ -20,12 +20,23 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <sndfile.h>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define WANT_VFS_STDIO_COMPAT
 #include <libaudcore/plugin.h>
 #include <libaudcore/i18n.h>
 #include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
+
+class MappedPCM;
 
 class SndfilePlugin : public InputPlugin
 {
@@ -46,6 +57,9 @@ public:
     bool is_our_file (const char * filename, VFSFile & file);
     bool read_tag (const char * filename, VFSFile & file, Tuple & tuple, Index<char> * image);
     bool play (const char * filename, VFSFile & file);
+
+private:
+    bool play_mapped (const MappedPCM & pcm, const SF_INFO & sfinfo);
 };
 
 EXPORT SndfilePlugin aud_plugin_instance;
@@ -301,6 +315,272 @@ bool SndfilePlugin::read_tag (const char * filename, VFSFile & file, Tuple & tup
     return true;
 }
 
+/* Fast path for uncompressed integer PCM in local WAV, W64 and AIFF files: the
+ * file is mapped into memory, the data chunk is located by walking the chunk
+ * headers, and the samples are passed to the output in their native format,
+ * skipping the conversion to float and back.  libsndfile is still used to
+ * validate the file and read the format; anything unusual (compressed or
+ * floating point data, AIFC, streams, remote files) takes the normal path.
+ * Touching a mapped page past the end of a file that has been truncated
+ * meanwhile (say, by a tag editor rewriting it in place) raises SIGBUS, so
+ * the file size is checked again before each block is played. */
+
+class MappedPCM
+{
+public:
+    ~MappedPCM ();
+
+    bool open (const char * filename, const SF_INFO & sfinfo);
+    int64_t frames_present () const;
+
+    const char * data = nullptr;  // first sample
+    int64_t frames = 0;
+    int frame_size = 0;
+    int format = 0;  // FMT_xxx
+
+private:
+    bool find_wav_data (int64_t & offset, int64_t & size) const;
+    bool find_w64_data (int64_t & offset, int64_t & size) const;
+    bool find_aiff_data (int64_t & offset, int64_t & size) const;
+
+    const unsigned char * m_map = nullptr;
+    int64_t m_size = 0;
+    int m_fd = -1;
+};
+
+static inline uint32_t get_le32 (const unsigned char * p)
+    { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24); }
+static inline uint32_t get_be32 (const unsigned char * p)
+    { return ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+static inline uint64_t get_le64 (const unsigned char * p)
+    { return get_le32 (p) | ((uint64_t) get_le32 (p + 4) << 32); }
+
+bool MappedPCM::find_wav_data (int64_t & offset, int64_t & size) const
+{
+    if (m_size < 12 || memcmp (m_map, "RIFF", 4) || memcmp (m_map + 8, "WAVE", 4))
+        return false;
+
+    for (int64_t pos = 12; pos + 8 <= m_size; )
+    {
+        const unsigned char * chunk = m_map + pos;
+        int64_t len = get_le32 (chunk + 4);
+
+        if (! memcmp (chunk, "data", 4))
+        {
+            offset = pos + 8;
+            /* streaming writers leave the size unset */
+            size = aud::min (len, m_size - offset);
+            return true;
+        }
+
+        pos += 8 + len + (len & 1);
+    }
+
+    return false;
+}
+
+bool MappedPCM::find_w64_data (int64_t & offset, int64_t & size) const
+{
+    static const unsigned char riff_guid[16] = {'r', 'i', 'f', 'f', 0x2e, 0x91,
+     0xcf, 0x11, 0xa5, 0xd6, 0x28, 0xdb, 0x04, 0xc1, 0x00, 0x00};
+    static const unsigned char data_guid[16] = {'d', 'a', 't', 'a', 0xf3, 0xac,
+     0xd3, 0x11, 0x8c, 0xd1, 0x00, 0xc0, 0x4f, 0x8e, 0xdb, 0x8a};
+
+    if (m_size < 40 || memcmp (m_map, riff_guid, 16))
+        return false;
+
+    /* 16-byte GUID, 8-byte size (including the header), 8-byte alignment */
+    for (int64_t pos = 40; pos + 24 <= m_size; )
+    {
+        const unsigned char * chunk = m_map + pos;
+        uint64_t len = get_le64 (chunk + 16);
+
+        if (len < 24 || len > (uint64_t) (m_size - pos) + 24)
+            return false;
+
+        if (! memcmp (chunk, data_guid, 16))
+        {
+            offset = pos + 24;
+            size = aud::min ((int64_t) len - 24, m_size - offset);
+            return true;
+        }
+
+        pos += (len + 7) & ~(uint64_t) 7;
+    }
+
+    return false;
+}
+
+bool MappedPCM::find_aiff_data (int64_t & offset, int64_t & size) const
+{
+    /* AIFC may be little-endian or compressed; leave it to libsndfile */
+    if (m_size < 12 || memcmp (m_map, "FORM", 4) || memcmp (m_map + 8, "AIFF", 4))
+        return false;
+
+    for (int64_t pos = 12; pos + 8 <= m_size; )
+    {
+        const unsigned char * chunk = m_map + pos;
+        int64_t len = get_be32 (chunk + 4);
+
+        if (! memcmp (chunk, "SSND", 4))
+        {
+            if (len < 8 || pos + 16 > m_size)
+                return false;
+
+            int64_t skip = get_be32 (chunk + 8);
+            offset = pos + 16 + skip;
+            size = aud::min (len - 8 - skip, m_size - offset);
+            return size >= 0;
+        }
+
+        pos += 8 + len + (len & 1);
+    }
+
+    return false;
+}
+
+bool MappedPCM::open (const char * filename, const SF_INFO & sfinfo)
+{
+#ifdef _WIN32
+    return false;
+#else
+    int type = sfinfo.format & SF_FORMAT_TYPEMASK;
+    bool big_endian = (type == SF_FORMAT_AIFF);
+
+    if (type != SF_FORMAT_WAV && type != SF_FORMAT_WAVEX &&
+     type != SF_FORMAT_W64 && type != SF_FORMAT_AIFF)
+        return false;
+
+    int sample_size;
+
+    switch (sfinfo.format & SF_FORMAT_SUBMASK)
+    {
+    case SF_FORMAT_PCM_U8:
+        format = FMT_U8;
+        sample_size = 1;
+        break;
+    case SF_FORMAT_PCM_S8:
+        format = FMT_S8;
+        sample_size = 1;
+        break;
+    case SF_FORMAT_PCM_16:
+        format = big_endian ? FMT_S16_BE : FMT_S16_LE;
+        sample_size = 2;
+        break;
+    case SF_FORMAT_PCM_24:
+        format = big_endian ? FMT_S24_3BE : FMT_S24_3LE;
+        sample_size = 3;
+        break;
+    case SF_FORMAT_PCM_32:
+        format = big_endian ? FMT_S32_BE : FMT_S32_LE;
+        sample_size = 4;
+        break;
+    default:
+        return false;
+    }
+
+    if (sfinfo.channels < 1 || sfinfo.samplerate < 1)
+        return false;
+
+    StringBuf path = uri_to_filename (filename);
+    if (! path)
+        return false;
+
+    int fd = ::open (path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    m_fd = fd;
+
+    struct stat st;
+    void * map = MAP_FAILED;
+
+    if (! fstat (fd, & st) && st.st_size > 0)
+        map = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (map == MAP_FAILED)
+        return false;
+
+    m_map = (const unsigned char *) map;
+    m_size = st.st_size;
+
+    int64_t offset = 0, size = 0;
+    bool found;
+
+    if (type == SF_FORMAT_W64)
+        found = find_w64_data (offset, size);
+    else if (type == SF_FORMAT_AIFF)
+        found = find_aiff_data (offset, size);
+    else
+        found = find_wav_data (offset, size);
+
+    if (! found)
+        return false;
+
+    frame_size = sample_size * sfinfo.channels;
+    frames = aud::min ((int64_t) sfinfo.frames, size / frame_size);
+    data = (const char *) m_map + offset;
+
+    madvise ((void *) m_map, m_size, MADV_SEQUENTIAL);
+
+    return frames > 0;
+#endif
+}
+
+/* number of frames still backed by the file */
+int64_t MappedPCM::frames_present () const
+{
+#ifdef _WIN32
+    return frames;
+#else
+    struct stat st;
+    if (fstat (m_fd, & st))
+        return 0;
+
+    int64_t size = aud::min ((int64_t) st.st_size, m_size) - (data - (const char *) m_map);
+    return aud::clamp (size / frame_size, (int64_t) 0, frames);
+#endif
+}
+
+MappedPCM::~MappedPCM ()
+{
+#ifndef _WIN32
+    if (m_map)
+        munmap ((void *) m_map, m_size);
+    if (m_fd >= 0)
+        ::close (m_fd);
+#endif
+}
+
+bool SndfilePlugin::play_mapped (const MappedPCM & pcm, const SF_INFO & sfinfo)
+{
+    /* 1/8 second per write keeps seeking responsive */
+    int64_t block = aud::max (sfinfo.samplerate / 8, 1);
+    int64_t pos = 0;
+
+    open_audio (pcm.format, sfinfo.samplerate, sfinfo.channels);
+
+    while (! check_stop ())
+    {
+        int seek_value = check_seek ();
+        if (seek_value != -1)
+        {
+            int64_t frames = aud::rescale<int64_t> (seek_value, 1000, sfinfo.samplerate);
+            pos = aud::min (frames, pcm.frames);
+        }
+
+        /* a file cut short ends playback just as a short read would */
+        int64_t frames = aud::min (block, pcm.frames_present () - pos);
+        if (frames <= 0)
+            break;
+
+        write_audio (pcm.data + pos * pcm.frame_size, frames * pcm.frame_size);
+        pos += frames;
+    }
+
+    return true;
+}
+
 bool SndfilePlugin::play (const char * filename, VFSFile & file)
 {
     SF_INFO sfinfo {}; // must be zeroed before sf_open()
@@ -312,6 +592,18 @@ bool SndfilePlugin::play (const char * filename, VFSFile & file)
     if (sndfile == nullptr)
         return false;
 
+    if (! stream)
+    {
+        MappedPCM pcm;
+
+        if (pcm.open (filename, sfinfo))
+        {
+            AUDDBG ("Playing %s from memory-mapped PCM.\n", filename);
+            sf_close (sndfile);
+            return play_mapped (pcm, sfinfo);
+        }
+    }
+
     open_audio (FMT_FLOAT, sfinfo.samplerate, sfinfo.channels);
 
     Index<float> buffer;
@@ -0,0 +1,242 @@
+/*
+ * spectrogram.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <gtk/gtk.h>
+
+#include <libaudcore/i18n.h>
+#include <libaudcore/index.h>
+#include <libaudcore/plugin.h>
+
+#include "../ui-common/band-map.h"
+
+#define MAX_BANDS 256
+#define DB_RANGE 60.0f /* dB shown between black and white */
+
+class Spectrogram : public VisPlugin
+{
+public:
+    static constexpr PluginInfo info = {
+        N_("Spectrogram"),
+        PACKAGE,
+        nullptr, // about
+        nullptr, // prefs
+        PluginGLibOnly
+    };
+
+    constexpr Spectrogram () : VisPlugin (info, Visualizer::Freq) {}
+
+    void cleanup ();
+
+    void * get_gtk_widget ();
+
+    void clear ();
+    void render_freq (const float * freq);
+};
+
+EXPORT Spectrogram aud_plugin_instance;
+
+/* The history is kept in an image used as a ring buffer: each frame writes a
+ * single column at the cursor, and the image is painted in two pieces so that
+ * the oldest column (the one at the cursor) ends up at the left edge.  Nothing
+ * is ever shifted, so a frame costs O(height) regardless of the width. */
+
+static GtkWidget * area = nullptr;
+static cairo_surface_t * surface = nullptr;
+static BandMap band_map;
+static int width, height, cursor;
+static Index<int> row_band; /* band shown in each pixel row */
+static uint32_t palette[256];
+
+static void make_palette ()
+{
+    static const struct {
+        float pos;
+        uint32_t color;
+    } stops[] = {
+        {0.0f, 0x000000},
+        {0.25f, 0x20106a},
+        {0.5f, 0xa0207a},
+        {0.75f, 0xff6010},
+        {0.9f, 0xffe040},
+        {1.0f, 0xffffff}
+    };
+
+    int s = 0;
+
+    for (int i = 0; i < 256; i ++)
+    {
+        float pos = i / 255.0f;
+
+        while (pos > stops[s + 1].pos)
+            s ++;
+
+        float t = (pos - stops[s].pos) / (stops[s + 1].pos - stops[s].pos);
+        uint32_t a = stops[s].color, b = stops[s + 1].color;
+        uint32_t color = 0;
+
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            int ca = (a >> shift) & 0xff, cb = (b >> shift) & 0xff;
+            color |= (uint32_t) (ca + (cb - ca) * t + 0.5f) << shift;
+        }
+
+        palette[i] = color;
+    }
+}
+
+void Spectrogram::render_freq (const float * freq)
+{
+    if (! surface)
+        return;
+
+    int bands = band_map.bands ();
+    float db[MAX_BANDS];
+    uint32_t colors[MAX_BANDS];
+
+    band_map.compute_db (freq, db);
+
+    for (int i = 0; i < bands; i ++)
+    {
+        int level = (db[i] + DB_RANGE) * (255 / DB_RANGE);
+        colors[i] = palette[aud::clamp (level, 0, 255)];
+    }
+
+    cairo_surface_flush (surface);
+
+    int stride = cairo_image_surface_get_stride (surface) / sizeof (uint32_t);
+    uint32_t * p = (uint32_t *) cairo_image_surface_get_data (surface) + cursor;
+
+    for (int y = 0; y < height; y ++, p += stride)
+        * p = colors[row_band[y]];
+
+    cairo_surface_mark_dirty_rectangle (surface, cursor, 0, 1, height);
+
+    if (++ cursor == width)
+        cursor = 0;
+
+    if (area)
+        gtk_widget_queue_draw (area);
+}
+
+void Spectrogram::clear ()
+{
+    if (surface)
+    {
+        cairo_surface_flush (surface);
+        memset (cairo_image_surface_get_data (surface), 0,
+         cairo_image_surface_get_stride (surface) * height);
+        cairo_surface_mark_dirty (surface);
+    }
+
+    cursor = 0;
+
+    if (area)
+        gtk_widget_queue_draw (area);
+}
+
+void Spectrogram::cleanup ()
+{
+    if (surface)
+    {
+        cairo_surface_destroy (surface);
+        surface = nullptr;
+    }
+
+    row_band.clear ();
+}
+
+static gboolean configure_event (GtkWidget * widget, GdkEventConfigure * event)
+{
+    if (event->width == width && event->height == height)
+        return true;
+
+    width = event->width;
+    height = event->height;
+    cursor = 0;
+
+    if (surface)
+    {
+        cairo_surface_destroy (surface);
+        surface = nullptr;
+    }
+
+    if (width < 1 || height < 1)
+        return true;
+
+    /* a new image surface is cleared to black */
+    surface = cairo_image_surface_create (CAIRO_FORMAT_RGB24, width, height);
+
+    int bands = aud::min (height, MAX_BANDS);
+    band_map.set_bands (bands);
+
+    /* low frequencies at the bottom */
+    row_band.resize (height);
+    for (int y = 0; y < height; y ++)
+        row_band[y] = (height - 1 - y) * bands / height;
+
+    if (! palette[255])
+        make_palette ();
+
+    gtk_widget_queue_draw (widget);
+    return true;
+}
+
+static gboolean draw_event (GtkWidget * widget)
+{
+    cairo_t * cr = gdk_cairo_create (gtk_widget_get_window (widget));
+
+    if (surface)
+    {
+        cairo_set_source_surface (cr, surface, -cursor, 0);
+        cairo_rectangle (cr, 0, 0, width - cursor, height);
+        cairo_fill (cr);
+
+        if (cursor)
+        {
+            cairo_set_source_surface (cr, surface, width - cursor, 0);
+            cairo_rectangle (cr, width - cursor, 0, cursor, height);
+            cairo_fill (cr);
+        }
+    }
+    else
+    {
+        cairo_paint (cr);
+    }
+
+    cairo_destroy (cr);
+    return true;
+}
+
+void * Spectrogram::get_gtk_widget ()
+{
+    area = gtk_drawing_area_new ();
+    width = height = 0;
+
+    g_signal_connect (area, "expose-event", (GCallback) draw_event, nullptr);
+    g_signal_connect (area, "configure-event", (GCallback) configure_event, nullptr);
+    g_signal_connect (area, "destroy", (GCallback) gtk_widget_destroyed, & area);
+
+    GtkWidget * frame = gtk_frame_new (nullptr);
+    gtk_frame_set_shadow_type ((GtkFrame *) frame, GTK_SHADOW_IN);
+    gtk_container_add ((GtkContainer *) frame, area);
+    return frame;
+}
@@ -0,0 +1,96 @@
+/*
+ * art-thumb-gtk.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "art-thumb.h"
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include <libaudcore/runtime.h>
+#include <libaudgui/libaudgui-gtk.h>
+
+// asks the loader to scale the image down to fit within the requested size
+// before it is decoded, so that JPEG images are decoded at a fraction of
+// their full resolution
+static void size_prepared (GdkPixbufLoader * loader, int width, int height, void * size_)
+{
+    int size = * (int *) size_;
+
+    if (width <= size && height <= size)
+        return;
+
+    if (width > height)
+        gdk_pixbuf_loader_set_size (loader, size, aud::max (1, aud::rescale (height, width, size)));
+    else
+        gdk_pixbuf_loader_set_size (loader, aud::max (1, aud::rescale (width, height, size)), size);
+}
+
+template<>
+bool ArtThumbLoader<AudguiPixbuf>::is_null (const AudguiPixbuf & image)
+{
+    return ! image;
+}
+
+template<>
+AudguiPixbuf ArtThumbLoader<AudguiPixbuf>::decode (const Index<char> & data, int size)
+{
+    GdkPixbufLoader * loader = gdk_pixbuf_loader_new ();
+    g_signal_connect (loader, "size-prepared", (GCallback) size_prepared, & size);
+
+    GError * error = nullptr;
+    AudguiPixbuf pixbuf;
+
+    if (gdk_pixbuf_loader_write (loader, (const unsigned char *) data.begin (), data.len (), & error) &&
+     gdk_pixbuf_loader_close (loader, & error))
+    {
+        GdkPixbuf * pb = gdk_pixbuf_loader_get_pixbuf (loader);
+        if (pb)
+            pixbuf = AudguiPixbuf ((GdkPixbuf *) g_object_ref (pb));
+    }
+    else
+    {
+        AUDWARN ("Error loading album art: %s\n", error->message);
+        g_error_free (error);
+
+        /* close it anyway; the error has already been reported */
+        gdk_pixbuf_loader_close (loader, nullptr);
+    }
+
+    g_object_unref (loader);
+    return pixbuf;
+}
+
+template<>
+AudguiPixbuf ArtThumbLoader<AudguiPixbuf>::load_cached (const char * path)
+{
+    return AudguiPixbuf (gdk_pixbuf_new_from_file (path, nullptr));
+}
+
+template<>
+void ArtThumbLoader<AudguiPixbuf>::save_cached (const AudguiPixbuf & image, const char * path)
+{
+    GError * error = nullptr;
+
+    if (! gdk_pixbuf_save (image.get (), path, "png", & error, nullptr))
+    {
+        AUDWARN ("Error saving %s: %s\n", path, error->message);
+        g_error_free (error);
+    }
+}
+
+template class ArtThumbLoader<AudguiPixbuf>;
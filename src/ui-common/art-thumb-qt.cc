@@ -0,0 +1,69 @@
+/*
+ * art-thumb-qt.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "art-thumb.h"
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QImage>
+#include <QImageReader>
+
+#include <libaudcore/runtime.h>
+
+template<>
+bool ArtThumbLoader<QImage>::is_null (const QImage & image)
+{
+    return image.isNull ();
+}
+
+template<>
+QImage ArtThumbLoader<QImage>::decode (const Index<char> & data, int size)
+{
+    QByteArray bytes = QByteArray::fromRawData (data.begin (), data.len ());
+    QBuffer buffer (& bytes);
+    QImageReader reader (& buffer);
+
+    // setting the scaled size lets the JPEG reader decode at a fraction of
+    // the full resolution
+    QSize full = reader.size ();
+    if (full.width () > size || full.height () > size)
+        reader.setScaledSize (full.scaled (size, size, Qt::KeepAspectRatio));
+
+    QImage image = reader.read ();
+    if (image.isNull ())
+        AUDWARN ("Error loading album art: %s\n",
+         reader.errorString ().toUtf8 ().constData ());
+
+    return image;
+}
+
+template<>
+QImage ArtThumbLoader<QImage>::load_cached (const char * path)
+{
+    return QImage (QString (path), "PNG");
+}
+
+template<>
+void ArtThumbLoader<QImage>::save_cached (const QImage & image, const char * path)
+{
+    if (! image.save (QString (path), "PNG"))
+        AUDWARN ("Error saving %s\n", path);
+}
+
+template class ArtThumbLoader<QImage>;
@@ -0,0 +1,185 @@
+/*
+ * art-thumb.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "art-thumb.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/drct.h>
+#include <libaudcore/runtime.h>
+
+// Cached thumbnails are PNG files named after a hash of the encoded image
+// and the size they were scaled to fit.  The hash is FNV-1a taken over
+// 64-bit words, which is fast enough for images of several megabytes.
+static StringBuf art_thumb_path (const Index<char> & data, int size)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    int len = data.len ();
+    int pos = 0;
+
+    for (; pos + 8 <= len; pos += 8)
+    {
+        uint64_t word;
+        memcpy (& word, & data[pos], 8);
+        hash = (hash ^ word) * 0x100000001b3;
+    }
+
+    for (; pos < len; pos ++)
+        hash = (hash ^ (unsigned char) data[pos]) * 0x100000001b3;
+
+    return filename_build ({aud_get_path (AudPath::UserDir), "art-thumbs",
+     str_printf ("%016llx-%d.png", (unsigned long long) hash, size)});
+}
+
+template<class Image>
+void ArtThumbLoader<Image>::request_current (int size)
+{
+    String filename = aud_drct_get_filename ();
+    AudArtPtr art = filename ? aud_art_request (filename, AUD_ART_DATA) : AudArtPtr ();
+
+    std::unique_lock<std::mutex> lock (m_mutex);
+
+    m_serial ++;
+    m_pending = false;
+
+    if (! art || ! art.data ())
+    {
+        lock.unlock ();
+        m_callback (Image (), m_user);
+        return;
+    }
+
+    m_request = {std::move (art), size, m_serial};
+    m_pending = true;
+
+    if (m_thread.joinable ())
+        m_cond.notify_one ();
+    else
+        m_thread = std::thread (& ArtThumbLoader::run, this);
+}
+
+template<class Image>
+void ArtThumbLoader<Image>::cancel ()
+{
+    std::lock_guard<std::mutex> lock (m_mutex);
+
+    m_serial ++;
+    m_pending = false;
+    m_request = Request ();
+}
+
+template<class Image>
+void ArtThumbLoader<Image>::stop ()
+{
+    std::unique_lock<std::mutex> lock (m_mutex);
+
+    m_serial ++;
+    m_pending = false;
+    m_request = Request ();
+
+    if (m_thread.joinable ())
+    {
+        m_quit = true;
+        m_cond.notify_one ();
+
+        lock.unlock ();
+        m_thread.join ();
+        lock.lock ();
+
+        m_quit = false;
+    }
+
+    m_result = Image ();
+    m_done.stop ();
+}
+
+template<class Image>
+void ArtThumbLoader<Image>::run ()
+{
+    std::unique_lock<std::mutex> lock (m_mutex);
+
+    while (true)
+    {
+        m_cond.wait (lock, [this] () { return m_quit || m_pending; });
+
+        if (m_quit)
+            break;
+
+        Request request = std::move (m_request);
+        m_pending = false;
+
+        lock.unlock ();
+
+        const Index<char> & data = * request.art.data ();
+        StringBuf path = art_thumb_path (data, request.size);
+
+        Image image = load_cached (path);
+
+        if (is_null (image))
+        {
+            image = decode (data, request.size);
+
+            if (! is_null (image))
+            {
+                StringBuf dir = filename_build ({aud_get_path (AudPath::UserDir), "art-thumbs"});
+
+                if (g_mkdir_with_parents (dir, 0755) == 0)
+                {
+                    /* write under a temporary name so that a partial file
+                     * is never picked up by another instance */
+                    StringBuf temp = str_concat ({path, ".tmp"});
+                    save_cached (image, temp);
+
+                    if (g_rename (temp, path) < 0)
+                        g_unlink (temp);
+                }
+                else
+                    AUDERR ("Failed to create %s\n", (const char *) dir);
+            }
+        }
+
+        lock.lock ();
+
+        m_result = std::move (image);
+        m_result_serial = request.serial;
+        m_done.queue (done, this);
+    }
+}
+
+template<class Image>
+void ArtThumbLoader<Image>::done (void * me_)
+{
+    auto me = (ArtThumbLoader *) me_;
+    std::unique_lock<std::mutex> lock (me->m_mutex);
+
+    if (me->m_result_serial != me->m_serial)
+        return; /* a newer request is pending */
+
+    Image image = std::move (me->m_result);
+    me->m_result = Image ();
+    me->m_result_serial = 0;
+
+    lock.unlock ();
+    me->m_callback (std::move (image), me->m_user);
+}
@@ -0,0 +1,93 @@
+/*
+ * art-thumb.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef UI_COMMON_ART_THUMB_H
+#define UI_COMMON_ART_THUMB_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <libaudcore/index.h>
+#include <libaudcore/mainloop.h>
+#include <libaudcore/probe.h>
+
+// Loads the album art of the current song on a worker thread, decoded
+// directly at the size it is shown at (JPEG images are downscaled by the
+// decoder).  The results are kept in an on-disk cache keyed by a hash of
+// the image data and the size, which is shared by the GTK and Qt
+// interfaces, so that a cover embedded in every track of an album is only
+// decoded once.  Image is AudguiPixbuf (art-thumb-gtk.cc) or QImage
+// (art-thumb-qt.cc).
+template<class Image>
+class ArtThumbLoader
+{
+public:
+    // called on the main thread with the image, or a null image if the
+    // current song has no album art
+    typedef void (* Callback) (Image && image, void * user);
+
+    ArtThumbLoader (Callback callback, void * user) :
+        m_callback (callback),
+        m_user (user) {}
+
+    ~ArtThumbLoader ()
+        { stop (); }
+
+    // starts loading the art of the current song to fit within size x size
+    // pixels; the result of an earlier request is dropped
+    void request_current (int size);
+    // drops the pending request, if any
+    void cancel ();
+    // also stops the worker thread
+    void stop ();
+
+private:
+    struct Request {
+        AudArtPtr art;
+        int size;
+        int serial;
+    };
+
+    // run on the worker thread; implemented per toolkit
+    static bool is_null (const Image & image);
+    static Image decode (const Index<char> & data, int size);
+    static Image load_cached (const char * path);
+    static void save_cached (const Image & image, const char * path);
+
+    void run ();
+    static void done (void * me);
+
+    Callback m_callback;
+    void * m_user;
+
+    int m_serial = 0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+    bool m_quit = false;
+    bool m_pending = false;
+    Request m_request;
+    Image m_result;
+    int m_result_serial = 0;
+    QueuedFunc m_done;
+};
+
+#endif
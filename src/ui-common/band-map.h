@@ -0,0 +1,52 @@
+/*
+ * band-map.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef UI_COMMON_BAND_MAP_H
+#define UI_COMMON_BAND_MAP_H
+
+#include <libaudcore/index.h>
+
+// Maps the linear frequency data passed to Visualizer::render_freq() onto
+// logarithmically spaced bands.  The fractional bin boundaries are turned into
+// a sparse table of weights once per band count, so that each frame is a
+// single multiply-accumulate pass over the input followed by a fast dB
+// conversion.
+class BandMap
+{
+public:
+    // number of bins passed to render_freq()
+    static constexpr int Bins = 256;
+
+    // (re)computes the weight tables if the band count has changed
+    void set_bands (int bands);
+    int bands () const
+        { return m_bands; }
+
+    // computes the level of each band in dB (0 dB = full scale), including a
+    // fudge factor to make the overall height the same as for 12 bands
+    void compute_db (const float * freq, float * db) const;
+
+private:
+    int m_bands = 0;
+    Index<int> m_first;    // first input bin of each band
+    Index<int> m_offset;   // start of each band's weights (plus one at the end)
+    Index<float> m_weights;
+};
+
+#endif
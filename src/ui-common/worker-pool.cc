@@ -0,0 +1,117 @@
+/*
+ * worker-pool.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "worker-pool.h"
+
+#include <unistd.h>
+
+#include <libaudcore/templates.h>
+
+void * WorkerPool::worker_main (void * data)
+{
+    Worker & worker = * (Worker *) data;
+    WorkerPool & pool = * worker.pool;
+    int seen = 0;
+
+    pthread_mutex_lock (& pool.m_mutex);
+
+    while (1)
+    {
+        while (! pool.m_quit && pool.m_generation == seen)
+            pthread_cond_wait (& pool.m_work_cond, & pool.m_mutex);
+
+        if (pool.m_quit)
+            break;
+
+        seen = pool.m_generation;
+        Func func = pool.m_func;
+        void * job = pool.m_data;
+
+        pthread_mutex_unlock (& pool.m_mutex);
+        func (worker.part, pool.parts (), job);
+        pthread_mutex_lock (& pool.m_mutex);
+
+        if (! (-- pool.m_pending))
+            pthread_cond_signal (& pool.m_done_cond);
+    }
+
+    pthread_mutex_unlock (& pool.m_mutex);
+    return nullptr;
+}
+
+void WorkerPool::start ()
+{
+    if (m_n_workers)
+        return;
+
+    int cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    int wanted = aud::clamp (cpus - 1, 0, MaxWorkers);
+
+    m_quit = false;
+
+    while (m_n_workers < wanted)
+    {
+        Worker & worker = m_workers[m_n_workers];
+        worker.pool = this;
+        worker.part = m_n_workers + 1;
+
+        if (pthread_create (& worker.thread, nullptr, worker_main, & worker) != 0)
+            break;
+
+        m_n_workers ++;
+    }
+}
+
+void WorkerPool::stop ()
+{
+    pthread_mutex_lock (& m_mutex);
+    m_quit = true;
+    pthread_cond_broadcast (& m_work_cond);
+    pthread_mutex_unlock (& m_mutex);
+
+    for (int i = 0; i < m_n_workers; i ++)
+        pthread_join (m_workers[i].thread, nullptr);
+
+    m_n_workers = 0;
+    m_generation = 0;
+}
+
+void WorkerPool::run (Func func, void * data)
+{
+    if (! m_n_workers)
+    {
+        func (0, 1, data);
+        return;
+    }
+
+    pthread_mutex_lock (& m_mutex);
+    m_func = func;
+    m_data = data;
+    m_pending = m_n_workers;
+    m_generation ++;
+    pthread_cond_broadcast (& m_work_cond);
+    pthread_mutex_unlock (& m_mutex);
+
+    func (0, parts (), data);
+
+    pthread_mutex_lock (& m_mutex);
+    while (m_pending)
+        pthread_cond_wait (& m_done_cond, & m_mutex);
+    pthread_mutex_unlock (& m_mutex);
+}
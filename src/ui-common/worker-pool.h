@@ -0,0 +1,69 @@
+/*
+ * worker-pool.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef UI_COMMON_WORKER_POOL_H
+#define UI_COMMON_WORKER_POOL_H
+
+#include <pthread.h>
+
+// A small pool of threads that split one job at a time with the calling
+// thread.  The job is divided into parts() parts: the caller runs part 0 and
+// worker n runs part n + 1, and run() returns once all of them are done.
+class WorkerPool
+{
+public:
+    static constexpr int MaxWorkers = 3;
+
+    typedef void (* Func) (int part, int parts, void * data);
+
+    // starts one worker per additional CPU, up to MaxWorkers; does nothing
+    // if the workers are running already
+    void start ();
+    void stop ();
+
+    int parts () const
+        { return m_n_workers + 1; }
+
+    void run (Func func, void * data);
+
+private:
+    struct Worker {
+        WorkerPool * pool;
+        int part;
+        pthread_t thread;
+    };
+
+    static void * worker_main (void * data);
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t m_work_cond = PTHREAD_COND_INITIALIZER;
+    pthread_cond_t m_done_cond = PTHREAD_COND_INITIALIZER;
+
+    Worker m_workers[MaxWorkers];
+    int m_n_workers = 0;
+    int m_generation = 0;
+    int m_pending = 0;
+    bool m_quit = false;
+
+    // current job, written only while no job is pending
+    Func m_func = nullptr;
+    void * m_data = nullptr;
+};
+
+#endif
@@ -232,6 +232,19 @@ vorbis_interleave_buffer(float **pcm, int samples, int ch, float *pcmout)
 }
 
 
+/* Playback starts without seek callbacks, so that libvorbisfile does not
+ * bisect the whole file to enumerate the links of a chained stream.  The
+ * seekable open (with full enumeration) is done when a seek is requested. */
+static bool reopen_seekable (VFSFile & file, OggVorbis_File * vf)
+{
+    ov_clear (vf);
+
+    if (file.fseek (0, VFS_SEEK_SET))
+        return false;
+
+    return ov_open_callbacks (& file, vf, nullptr, 0, vorbis_callbacks) >= 0;
+}
+
 #define PCM_FRAMES 1024
 #define PCM_BUFSIZE (PCM_FRAMES * 2)
 
@@ -248,10 +261,10 @@ bool VorbisPlugin::play (const char * filename, VFSFile & file)
     memset(&vf, 0, sizeof(vf));
 
     bool stream = (file.fsize () < 0);
+    bool seekable = false;
     bool error = false;
 
-    if (ov_open_callbacks (& file, & vf, nullptr, 0, stream ?
-     vorbis_callbacks_stream : vorbis_callbacks) < 0)
+    if (ov_open_callbacks (& file, & vf, nullptr, 0, vorbis_callbacks_stream) < 0)
     {
         error = true;
         goto play_cleanup;
@@ -284,11 +297,27 @@ bool VorbisPlugin::play (const char * filename, VFSFile & file)
     {
         int seek_value = check_seek ();
 
-        if (seek_value >= 0 && ov_time_seek (& vf, (double) seek_value / 1000) < 0)
+        if (seek_value >= 0)
         {
-            AUDERR ("seek failed\n");
-            error = true;
-            break;
+            if (! seekable && ! stream)
+            {
+                if (! reopen_seekable (file, & vf))
+                {
+                    AUDERR ("Failed to reopen %s for seeking.\n", filename);
+                    error = true;
+                    break;
+                }
+
+                seekable = true;
+                last_section = -1;
+            }
+
+            if (ov_time_seek (& vf, (double) seek_value / 1000) < 0)
+            {
+                AUDERR ("seek failed\n");
+                error = true;
+                break;
+            }
         }
 
         int current_section = last_section;
@@ -340,6 +369,153 @@ play_cleanup:
     return ! error;
 }
 
+#define TAIL_MIN 65536
+#define TAIL_MAX 1048576
+
+/* Finds the last page with a granule position in the file, reading backwards
+ * from the end in growing chunks. */
+static bool find_last_page (VFSFile & file, int64_t size, int64_t & granule,
+ long & serial)
+{
+    for (int64_t chunk = TAIL_MIN; chunk <= TAIL_MAX; chunk *= 2)
+    {
+        int64_t start = aud::max (size - chunk, (int64_t) 0);
+        if (file.fseek (start, VFS_SEEK_SET))
+            return false;
+
+        ogg_sync_state oy;
+        ogg_page og;
+        bool found = false;
+
+        ogg_sync_init (& oy);
+
+        char * buffer = ogg_sync_buffer (& oy, size - start);
+        int64_t bytes = file.fread (buffer, 1, size - start);
+
+        if (bytes > 0)
+            ogg_sync_wrote (& oy, bytes);
+
+        long ret;
+        while ((ret = ogg_sync_pageseek (& oy, & og)) != 0)
+        {
+            if (ret > 0 && ogg_page_granulepos (& og) >= 0)
+            {
+                granule = ogg_page_granulepos (& og);
+                serial = ogg_page_serialno (& og);
+                found = true;
+            }
+        }
+
+        ogg_sync_clear (& oy);
+
+        if (found)
+            return true;
+        if (! start)
+            break;
+    }
+
+    return false;
+}
+
+/* Finds the position of the first sample of the stream <serial>, which is not
+ * zero for a stream that was captured starting in the middle.  As in
+ * libvorbisfile, this is the granule position of the first audio page minus
+ * the samples in the packets that end on that page. */
+static bool find_first_sample (VFSFile & file, vorbis_info * info, long serial,
+ int64_t & first)
+{
+    if (file.fseek (0, VFS_SEEK_SET))
+        return false;
+
+    ogg_sync_state oy;
+    ogg_stream_state os;
+    ogg_page og;
+    ogg_packet op;
+
+    ogg_sync_init (& oy);
+    ogg_stream_init (& os, serial);
+
+    int packets = 0;
+    long lastblock = -1;
+    int64_t samples = 0;
+    bool found = false;
+
+    for (int64_t read = 0; ! found && read < TAIL_MAX; )
+    {
+        if (ogg_sync_pageout (& oy, & og) != 1)
+        {
+            char * buffer = ogg_sync_buffer (& oy, TAIL_MIN);
+            int64_t bytes = file.fread (buffer, 1, TAIL_MIN);
+
+            if (bytes <= 0)
+                break;
+
+            ogg_sync_wrote (& oy, bytes);
+            read += bytes;
+            continue;
+        }
+
+        if (ogg_page_serialno (& og) != serial)
+            continue;
+
+        ogg_stream_pagein (& os, & og);
+
+        int ret;
+        while ((ret = ogg_stream_packetout (& os, & op)) != 0)
+        {
+            if (ret < 0)
+                continue;  /* hole in the data */
+
+            /* the first three packets are the headers */
+            if (packets ++ < 3)
+                continue;
+
+            long block = vorbis_packet_blocksize (info, & op);
+            if (block < 0)
+                continue;
+
+            if (lastblock >= 0)
+                samples += (lastblock + block) / 4;
+
+            lastblock = block;
+        }
+
+        if (packets > 3 && ogg_page_granulepos (& og) >= 0)
+        {
+            /* less than zero when samples are trimmed from the start */
+            first = aud::max (ogg_page_granulepos (& og) - samples, (int64_t) 0);
+            found = true;
+        }
+    }
+
+    ogg_stream_clear (& os);
+    ogg_sync_clear (& oy);
+
+    return found;
+}
+
+/* Gets the length in milliseconds from the first and last pages of the file. */
+static int64_t read_length (VFSFile & file, OggVorbis_File * vf, vorbis_info * info)
+{
+    int64_t size = file.fsize ();
+    int64_t granule, first;
+    long serial;
+
+    if (size < 0 || info->rate <= 0 || ! find_last_page (file, size, granule, serial))
+        return -1;
+
+    /* In a chained file the granule position restarts in each link, so
+     * without enumerating the links the best we can do is an estimate from
+     * the bitrate of the first one. */
+    if (serial != ov_serialnumber (vf, -1))
+        return (info->bitrate_nominal > 0) ? size * 8000 / info->bitrate_nominal : -1;
+
+    if (! find_first_sample (file, info, serial, first) || first > granule)
+        first = 0;
+
+    return aud::rescale<int64_t> (granule - first, info->rate, 1000);
+}
+
 bool VorbisPlugin::read_tag (const char * filename, VFSFile & file,
  Tuple & tuple, Index<char> * image)
 {
@@ -348,12 +524,11 @@ bool VorbisPlugin::read_tag (const char * filename, VFSFile & file,
     bool stream = (file.fsize () < 0);
 
     /*
-     * The open function performs full stream detection and
-     * machine initialization.  If it returns zero, the stream
-     * *is* Vorbis and we're fully ready to decode.
+     * Opening without seek callbacks makes libvorbisfile read only the
+     * headers of the first link, rather than bisecting the whole file to
+     * find all the links of a chained stream.
      */
-    if (ov_open_callbacks (& file, & vfile, nullptr, 0, stream ?
-     vorbis_callbacks_stream : vorbis_callbacks) < 0)
+    if (ov_open_callbacks (& file, & vfile, nullptr, 0, vorbis_callbacks_stream) < 0)
         return false;
 
     vorbis_info * info = ov_info (& vfile, -1);
@@ -362,7 +537,11 @@ bool VorbisPlugin::read_tag (const char * filename, VFSFile & file,
     tuple.set_format ("Ogg Vorbis", info->channels, info->rate, info->bitrate_nominal / 1000);
 
     if (! stream)
-        tuple.set_int (Tuple::Length, ov_time_total (& vfile, -1) * 1000);
+    {
+        int64_t length = read_length (file, & vfile, info);
+        if (length > 0)
+            tuple.set_int (Tuple::Length, length);
+    }
 
     if (comment)
         read_comment (comment, tuple);
@@ -1,6 +1,11 @@
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <wavpack/wavpack.h>
 
 #define WANT_VFS_STDIO_COMPAT
@@ -10,7 +15,10 @@
 #include <libaudcore/plugin.h>
 #include <libaudcore/audstrings.h>
 
-#define BUFFER_SIZE 256 /* read buffer size, in samples / frames */
+#define MIN_BLOCK 256 /* decode block size, in frames */
+#define MAX_BLOCK 16384
+#define READ_AHEAD 262144 /* per input file, in bytes */
+#define READ_CHUNK 32768
 #define SAMPLE_SIZE(a) (a == 8 ? sizeof(uint8_t) : (a == 16 ? sizeof(uint16_t) : sizeof(uint32_t)))
 #define SAMPLE_FMT(a) (a == 8 ? FMT_S8 : (a == 16 ? FMT_S16_NE : (a == 24 ? FMT_S24_NE : FMT_S32_NE)))
 
@@ -99,20 +107,316 @@ WavpackStreamReader wv_readers = {
     wv_write_bytes
 };
 
-static bool wv_attach (const char * filename, VFSFile & wv_input,
- VFSFile & wvc_input, WavpackContext * * ctx, char * error, int flags)
+/* During playback, each input file (.wv and, for hybrid files, .wvc) is read
+ * ahead by a background thread, so that the decoder does not wait on the two
+ * files in lock-step.  Seeks outside the buffered range restart the reader.
+ * If the thread cannot be started, the file is read directly. */
+
+class ReadAhead
+{
+public:
+    ReadAhead (VFSFile & file);
+    ~ReadAhead ();
+
+    int64_t read (void * data, int64_t len);
+    int seek (int64_t offset, VFSSeekType whence);
+
+    int64_t tell () const
+        { return m_pos; }
+    int64_t size () const
+        { return m_size; }
+
+private:
+    static void * run (void * data);
+    void fill_locked ();
+
+    VFSFile & m_file;
+    int64_t m_size;
+
+    pthread_t m_thread;
+    bool m_threaded = false;
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t m_cond = PTHREAD_COND_INITIALIZER;
+
+    Index<char> m_ring;
+    int m_head = 0, m_fill = 0;
+    int64_t m_pos = 0;  /* read position, corresponds to m_head */
+
+    int m_generation = 0;  /* incremented by each seek */
+    int64_t m_seek_to = -1;
+    bool m_eof = false, m_quit = false;
+};
+
+ReadAhead::ReadAhead (VFSFile & file) :
+    m_file (file),
+    m_size (file.fsize ())
+{
+    m_pos = aud::max (file.ftell (), (int64_t) 0);
+
+    m_ring.resize (READ_AHEAD);
+    m_threaded = ! pthread_create (& m_thread, nullptr, run, this);
+
+    if (! m_threaded)
+    {
+        AUDWARN ("Failed to start read-ahead thread; reading directly.\n");
+        m_ring.clear ();
+    }
+}
+
+ReadAhead::~ReadAhead ()
+{
+    if (! m_threaded)
+        return;
+
+    pthread_mutex_lock (& m_mutex);
+    m_quit = true;
+    pthread_cond_broadcast (& m_cond);
+    pthread_mutex_unlock (& m_mutex);
+
+    pthread_join (m_thread, nullptr);
+}
+
+void * ReadAhead::run (void * data)
+{
+    auto self = (ReadAhead *) data;
+
+    pthread_mutex_lock (& self->m_mutex);
+
+    while (! self->m_quit)
+    {
+        if (self->m_seek_to < 0 && (self->m_eof || self->m_fill == READ_AHEAD))
+            pthread_cond_wait (& self->m_cond, & self->m_mutex);
+        else
+            self->fill_locked ();
+    }
+
+    pthread_mutex_unlock (& self->m_mutex);
+    return nullptr;
+}
+
+/* Called with the mutex held; drops it during file access. */
+void ReadAhead::fill_locked ()
+{
+    int generation = m_generation;
+    int64_t seek_to = m_seek_to;
+
+    if (seek_to >= 0)
+    {
+        m_seek_to = -1;
+
+        pthread_mutex_unlock (& m_mutex);
+        bool failed = m_file.fseek (seek_to, VFS_SEEK_SET);
+        pthread_mutex_lock (& m_mutex);
+
+        if (failed && generation == m_generation)
+        {
+            m_eof = true;
+            pthread_cond_broadcast (& m_cond);
+        }
+
+        return;
+    }
+
+    int tail = (m_head + m_fill) % READ_AHEAD;
+    int len = aud::min (READ_AHEAD - m_fill, READ_AHEAD - tail);
+    len = aud::min (len, READ_CHUNK);
+
+    char buf[READ_CHUNK];
+
+    pthread_mutex_unlock (& m_mutex);
+    int64_t got = m_file.fread (buf, 1, len);
+    pthread_mutex_lock (& m_mutex);
+
+    /* discard data read across a seek */
+    if (generation != m_generation)
+        return;
+
+    if (got > 0)
+    {
+        memcpy (m_ring.begin () + tail, buf, got);
+        m_fill += got;
+    }
+
+    if (got < len)
+        m_eof = true;
+
+    pthread_cond_broadcast (& m_cond);
+}
+
+int64_t ReadAhead::read (void * data, int64_t len)
+{
+    if (! m_threaded)
+    {
+        int64_t got = m_file.fread (data, 1, len);
+        m_pos += aud::max (got, (int64_t) 0);
+        return got;
+    }
+
+    int64_t done = 0;
+
+    pthread_mutex_lock (& m_mutex);
+
+    while (done < len)
+    {
+        while (! m_fill && ! m_eof)
+            pthread_cond_wait (& m_cond, & m_mutex);
+
+        if (! m_fill)
+            break;
+
+        int64_t n = aud::min (len - done, (int64_t) aud::min (m_fill, READ_AHEAD - m_head));
+
+        memcpy ((char *) data + done, m_ring.begin () + m_head, n);
+        m_head = (m_head + n) % READ_AHEAD;
+        m_fill -= n;
+        m_pos += n;
+        done += n;
+
+        pthread_cond_broadcast (& m_cond);
+    }
+
+    pthread_mutex_unlock (& m_mutex);
+    return done;
+}
+
+int ReadAhead::seek (int64_t offset, VFSSeekType whence)
+{
+    pthread_mutex_lock (& m_mutex);
+
+    int64_t target = offset;
+    if (whence == VFS_SEEK_CUR)
+        target += m_pos;
+    else if (whence == VFS_SEEK_END)
+        target += m_size;
+
+    if (target < 0 || (m_size >= 0 && target > m_size))
+    {
+        pthread_mutex_unlock (& m_mutex);
+        return -1;
+    }
+
+    if (! m_threaded)
+    {
+        pthread_mutex_unlock (& m_mutex);
+
+        if (m_file.fseek (target, VFS_SEEK_SET))
+            return -1;
+
+        m_pos = target;
+        return 0;
+    }
+
+    if (target >= m_pos && target - m_pos <= m_fill)
+    {
+        /* skip forward within the buffer */
+        int n = target - m_pos;
+        m_head = (m_head + n) % READ_AHEAD;
+        m_fill -= n;
+    }
+    else
+    {
+        m_generation ++;
+        m_seek_to = target;
+        m_head = m_fill = 0;
+        m_eof = false;
+    }
+
+    m_pos = target;
+
+    pthread_cond_broadcast (& m_cond);
+    pthread_mutex_unlock (& m_mutex);
+    return 0;
+}
+
+static int32_t ra_read_bytes (void * id, void * data, int32_t bcount)
+{
+    return ((ReadAhead *) id)->read (data, bcount);
+}
+
+static uint32_t ra_get_pos (void * id)
+{
+    return aud::clamp (((ReadAhead *) id)->tell (), (int64_t) 0, (int64_t) 0xffffffff);
+}
+
+static int ra_set_pos_abs (void * id, uint32_t pos)
+{
+    return ((ReadAhead *) id)->seek (pos, VFS_SEEK_SET);
+}
+
+static int ra_set_pos_rel (void * id, int32_t delta, int mode)
+{
+    return ((ReadAhead *) id)->seek (delta, to_vfs_seek_type (mode));
+}
+
+static int ra_push_back_byte (void * id, int c)
+{
+    return (((ReadAhead *) id)->seek (-1, VFS_SEEK_CUR) == 0) ? c : -1;
+}
+
+static uint32_t ra_get_length (void * id)
+{
+    return aud::clamp (((ReadAhead *) id)->size (), (int64_t) 0, (int64_t) 0xffffffff);
+}
+
+static int ra_can_seek (void * id)
+{
+    return (((ReadAhead *) id)->size () >= 0);
+}
+
+static int32_t ra_write_bytes (void * id, void * data, int32_t bcount)
+{
+    return 0;
+}
+
+WavpackStreamReader ra_readers = {
+    ra_read_bytes,
+    ra_get_pos,
+    ra_set_pos_abs,
+    ra_set_pos_rel,
+    ra_push_back_byte,
+    ra_get_length,
+    ra_can_seek,
+    ra_write_bytes
+};
+
+/* Packs decoded samples into the output format.  WavpackUnpackSamples() always
+ * returns values within range for the bit depth, so the saturating packs give
+ * the same result as truncation.  24- and 32-bit samples are written straight
+ * from the decode buffer. */
+static void pack_s8 (const int32_t * in, int8_t * out, int n)
 {
-    if (flags & OPEN_WVC)
+    int i = 0;
+
+#ifdef __SSE2__
+    for (; i + 16 <= n; i += 16)
     {
-        StringBuf corrFilename = str_concat ({filename, "c"});
-        if (VFSFile::test_file (corrFilename, VFS_IS_REGULAR))
-            wvc_input = VFSFile (corrFilename, "r");
+        __m128i a = _mm_packs_epi32 (_mm_loadu_si128 ((const __m128i *) (in + i)),
+         _mm_loadu_si128 ((const __m128i *) (in + i + 4)));
+        __m128i b = _mm_packs_epi32 (_mm_loadu_si128 ((const __m128i *) (in + i + 8)),
+         _mm_loadu_si128 ((const __m128i *) (in + i + 12)));
+        _mm_storeu_si128 ((__m128i *) (out + i), _mm_packs_epi16 (a, b));
     }
+#endif
+
+    for (; i < n; i ++)
+        out[i] = in[i];
+}
 
-    * ctx = WavpackOpenFileInputEx (& wv_readers, & wv_input,
-     wvc_input ? (& wvc_input) : nullptr, error, flags, 0);
+static void pack_s16 (const int32_t * in, int16_t * out, int n)
+{
+    int i = 0;
 
-    return (* ctx != nullptr);
+#ifdef __SSE2__
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i a = _mm_loadu_si128 ((const __m128i *) (in + i));
+        __m128i b = _mm_loadu_si128 ((const __m128i *) (in + i + 4));
+        _mm_storeu_si128 ((__m128i *) (out + i), _mm_packs_epi32 (a, b));
+    }
+#endif
+
+    for (; i < n; i ++)
+        out[i] = in[i];
 }
 
 static void wv_deattach (WavpackContext * ctx)
@@ -127,75 +431,89 @@ bool WavpackPlugin::play (const char * filename, VFSFile & file)
     WavpackContext *ctx = nullptr;
     VFSFile wvc_input;
 
-    if (! wv_attach (filename, file, wvc_input, & ctx, nullptr, OPEN_TAGS | OPEN_WVC))
+    StringBuf corrFilename = str_concat ({filename, "c"});
+    if (VFSFile::test_file (corrFilename, VFS_IS_REGULAR))
+        wvc_input = VFSFile (corrFilename, "r");
+
     {
-        AUDERR ("Error opening Wavpack file '%s'.", filename);
-        return false;
-    }
+        ReadAhead wv_reader (file);
+        SmartPtr<ReadAhead> wvc_reader;
 
-    sample_rate = WavpackGetSampleRate(ctx);
-    num_channels = WavpackGetNumChannels(ctx);
-    bits_per_sample = WavpackGetBitsPerSample(ctx);
-    num_samples = WavpackGetNumSamples(ctx);
+        if (wvc_input)
+            wvc_reader.capture (new ReadAhead (wvc_input));
 
-    set_stream_bitrate(WavpackGetAverageBitrate(ctx, num_channels));
-    open_audio(SAMPLE_FMT(bits_per_sample), sample_rate, num_channels);
+        ctx = WavpackOpenFileInputEx (& ra_readers, & wv_reader,
+         wvc_reader.get (), nullptr, OPEN_TAGS | OPEN_WVC, 0);
 
-    Index<int32_t> input;
-    input.resize (BUFFER_SIZE * num_channels);
+        if (! ctx)
+        {
+            AUDERR ("Error opening Wavpack file '%s'.", filename);
+            return false;
+        }
 
-    Index<char> output;
-    output.resize (BUFFER_SIZE * num_channels * SAMPLE_SIZE (bits_per_sample));
+        sample_rate = WavpackGetSampleRate(ctx);
+        num_channels = WavpackGetNumChannels(ctx);
+        bits_per_sample = WavpackGetBitsPerSample(ctx);
+        num_samples = WavpackGetNumSamples(ctx);
 
-    while (! check_stop ())
-    {
-        int seek_value = check_seek ();
-        if (seek_value >= 0)
-            WavpackSeekSample (ctx, (int64_t) seek_value * sample_rate / 1000);
+        set_stream_bitrate(WavpackGetAverageBitrate(ctx, num_channels));
+        open_audio(SAMPLE_FMT(bits_per_sample), sample_rate, num_channels);
 
-        /* Decode audio data */
-        unsigned samples_left = num_samples - WavpackGetSampleIndex(ctx);
+        /* about 1/10 second per unpack call and per write */
+        int block = aud::clamp (sample_rate / 10, MIN_BLOCK, MAX_BLOCK);
 
-        if (samples_left == 0)
-            break;
+        Index<int32_t> input;
+        input.resize (block * num_channels);
 
-        int ret = WavpackUnpackSamples (ctx, input.begin (), BUFFER_SIZE);
+        Index<char> output;
+        if (bits_per_sample <= 16)
+            output.resize (block * num_channels * SAMPLE_SIZE (bits_per_sample));
 
-        if (ret < 0)
-        {
-            AUDERR ("Error decoding file.\n");
-            break;
-        }
-        else
+        while (! check_stop ())
         {
+            int seek_value = check_seek ();
+            if (seek_value >= 0)
+                WavpackSeekSample (ctx, (int64_t) seek_value * sample_rate / 1000);
+
+            /* Decode audio data */
+            unsigned samples_left = num_samples - WavpackGetSampleIndex(ctx);
+
+            if (samples_left == 0)
+                break;
+
+            int ret = WavpackUnpackSamples (ctx, input.begin (),
+             aud::min (samples_left, (unsigned) block));
+
+            if (ret < 0)
+            {
+                AUDERR ("Error decoding file.\n");
+                break;
+            }
+
+            if (ret == 0)
+                break;
+
             /* Perform audio data conversion and output */
-            int32_t * rp = input.begin ();
-            int8_t * wp = (int8_t *) output.begin ();
-            int16_t * wp2 = (int16_t *) output.begin ();
-            int32_t * wp4 = (int32_t *) output.begin ();
+            int samples = ret * num_channels;
 
             if (bits_per_sample == 8)
             {
-                for (int i = 0; i < ret * num_channels; i++, wp++, rp++)
-                    *wp = *rp & 0xff;
+                pack_s8 (input.begin (), (int8_t *) output.begin (), samples);
+                write_audio (output.begin (), samples);
             }
             else if (bits_per_sample == 16)
             {
-                for (int i = 0; i < ret * num_channels; i++, wp2++, rp++)
-                    *wp2 = *rp & 0xffff;
+                pack_s16 (input.begin (), (int16_t *) output.begin (), samples);
+                write_audio (output.begin (), sizeof (int16_t) * samples);
             }
-            else if (bits_per_sample == 24 || bits_per_sample == 32)
-            {
-                for (int i = 0; i < ret * num_channels; i++, wp4++, rp++)
-                    *wp4 = *rp;
-            }
-
-            write_audio (output.begin (),
-             ret * num_channels * SAMPLE_SIZE (bits_per_sample));
+            else
+                write_audio (input.begin (), sizeof (int32_t) * samples);
         }
+
+        /* the readers must outlive the context */
+        wv_deattach (ctx);
     }
 
-    wv_deattach (ctx);
     return true;
 }
 
@@ -23,6 +23,7 @@
 #include "thumb_instructions.h"
 #include "cp15.h"
 #include "bios.h"
+#include "mem.h"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -317,6 +318,45 @@ u32 armcpu_switchMode(armcpu_t *armcpu, u8 mode)
 	return oldmode;
 }
 
+/* Instruction fetches from plain memory are read straight through the MMU
+ * page map; only I/O, CFlash and the ARM9 DTCM need the full MMU_read path. */
+static INLINE BOOL armcpu_direct_fetch(u32 proc, u32 adr)
+{
+#ifdef MMU_ENABLE_ACL
+	return false;
+#else
+	if((adr & 0x0F000000) == 0x04000000)
+		return false;
+	if((adr >= 0x08800000) && (adr < 0x09900000))
+		return false;
+	if((proc == ARMCPU_ARM9) && ((adr & ~0x3FFF) == MMU.DTCMRegion))
+		return false;
+	return true;
+#endif
+}
+
+static INLINE u32 armcpu_fetch32(u32 proc, u32 adr)
+{
+	if(armcpu_direct_fetch(proc, adr))
+	{
+		u32 region = (adr >> 20) & 0xFF;
+		return T1ReadLong(MMU.MMU_MEM[proc][region], adr & MMU.MMU_MASK[proc][region]);
+	}
+
+	return MMU_read32_acl(proc, adr, CP15_ACCESS_EXECUTE);
+}
+
+static INLINE u16 armcpu_fetch16(u32 proc, u32 adr)
+{
+	if(armcpu_direct_fetch(proc, adr))
+	{
+		u32 region = (adr >> 20) & 0xFF;
+		return T1ReadWord(MMU.MMU_MEM[proc][region], adr & MMU.MMU_MASK[proc][region]);
+	}
+
+	return MMU_read16_acl(proc, adr, CP15_ACCESS_EXECUTE);
+}
+
 u32 armcpu_prefetch(armcpu_t *armcpu)
 {
 #ifdef GDB_STUB
@@ -337,7 +377,7 @@ u32 armcpu_prefetch(armcpu_t *armcpu)
 			armcpu->R[15] = armcpu->next_instruction + 4;
 		}
 #else
-		armcpu->instruction = MMU_read32_acl(armcpu->proc_ID, armcpu->next_instruction,CP15_ACCESS_EXECUTE);
+		armcpu->instruction = armcpu_fetch32(armcpu->proc_ID, armcpu->next_instruction);
 
 		armcpu->instruct_adr = armcpu->next_instruction;
 		armcpu->next_instruction += 4;
@@ -359,7 +399,7 @@ u32 armcpu_prefetch(armcpu_t *armcpu)
 		armcpu->R[15] = armcpu->next_instruction + 2;
 	}
 #else
-	armcpu->instruction = MMU_read16_acl(armcpu->proc_ID, armcpu->next_instruction,CP15_ACCESS_EXECUTE);
+	armcpu->instruction = armcpu_fetch16(armcpu->proc_ID, armcpu->next_instruction);
 
 	armcpu->instruct_adr = armcpu->next_instruction;
 	armcpu->next_instruction += 2;